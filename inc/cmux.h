@@ -19,11 +19,232 @@ extern "C" {
 
 //#define CMUX_DEBUG
 
+/* frames are delivered as views into cmux_buffer instead of being copied out */
+//#define CMUX_USING_RX_ZERO_COPY
+
+/* frames are allocated from fixed-size memory pools of cmux object instead of heap */
+//#define CMUX_USING_FRAME_POOL
+
+/* frames from all channels are packed into one serial write, flushed when tx buffer is full or time is up */
+//#define CMUX_USING_TX_BATCH
+
+/* rx_indicate of a channel is invoked once for all frames parsed from one serial read, with all the bytes queued */
+//#define CMUX_USING_RX_COALESCE
+
+/* receive thread polls serial with backoff under sustained load instead of waking up on every rx_indicate of serial */
+//#define CMUX_USING_RX_POLL
+
+/* advanced option (mode 1 of AT+CMUX): frames are delimited by 0x7E flags with 0x7D escaping instead of length field */
+//#define CMUX_USING_ADVANCED_OPTION
+
+/* error recovery mode of advanced option (subset 2 of AT+CMUX): data channels send numbered I frames, the modem
+ * acknowledges them and the lost ones are sent again */
+//#define CMUX_USING_ERROR_RECOVERY
+#if defined(CMUX_USING_ERROR_RECOVERY) && !defined(CMUX_USING_ADVANCED_OPTION)
+#error "CMUX_USING_ERROR_RECOVERY needs CMUX_USING_ADVANCED_OPTION"
+#endif
+
+/* FCS is calculated by slice-by-4 or slice-by-8 tables, the default is one table lookup per byte */
+//#define CMUX_USING_FCS_SLICE_BY_4
+//#define CMUX_USING_FCS_SLICE_BY_8
+
 /* CMUX using long frame mode by default */
 #define CMUX_RECV_READ_MAX 2048
 
+/* the receive thread of cmux object, serial data is read into cmux buffer instead of its stack;
+ * the priority can be changed by CMUX_CTRL_SET_RECV_PRIORITY */
+#ifndef CMUX_THREAD_STACK_SIZE
+#define CMUX_THREAD_STACK_SIZE   2048
+#endif
+#ifndef CMUX_THREAD_PRIORITY
+#define CMUX_THREAD_PRIORITY     8
+#endif
+
+#ifdef CMUX_USING_RX_POLL
+/* the bytes read in one wakeup to start polling, polling interval doubles from 1 tick while less data comes */
+#ifndef CMUX_RX_POLL_THRESHOLD
+#define CMUX_RX_POLL_THRESHOLD   (CMUX_RECV_READ_MAX / 2)
+#endif
+/* receive thread waits for rx_indicate again when polling interval is longer than it */
+#ifndef CMUX_RX_POLL_TIME_MAX
+#define CMUX_RX_POLL_TIME_MAX    8
+#endif
+#endif
+
+/* cmux buffer keeps frame data in zero copy mode, otherwise it only holds the data of one serial read */
 #ifndef CMUX_BUFFER_SIZE
+#ifdef CMUX_USING_RX_ZERO_COPY
 #define CMUX_BUFFER_SIZE   (CMUX_RECV_READ_MAX * 2)
+#else
+#define CMUX_BUFFER_SIZE   CMUX_RECV_READ_MAX
+#endif
+#endif
+
+#ifdef CMUX_USING_RX_ZERO_COPY
+/* the ticks cmux buffer may stay full, then the oldest frames queued for the channel holding the most are dropped */
+#ifndef CMUX_RX_STALL_TIME
+#define CMUX_RX_STALL_TIME       (RT_TICK_PER_SECOND / 10)
+#endif
+#endif
+
+/* the max frame size, it shouldn't be less than N1 of the AT+CMUX command */
+#ifndef CMUX_FRAME_SIZE_MAX
+#define CMUX_FRAME_SIZE_MAX 2048
+#endif
+
+/* N1 a data channel asks for by PN when it is opened, the modem may answer a smaller one */
+#ifndef CMUX_PN_FRAME_SIZE
+#define CMUX_PN_FRAME_SIZE CMUX_FRAME_SIZE_MAX
+#endif
+
+/* flag, address, control, length(2), fcs, flag */
+#define CMUX_FRAME_OVERHEAD 7
+
+#ifdef CMUX_USING_TX_BATCH
+#ifndef CMUX_TX_BUFFER_SIZE
+#define CMUX_TX_BUFFER_SIZE      ((CMUX_FRAME_SIZE_MAX + CMUX_FRAME_OVERHEAD) * 2)
+#endif
+/* the max ticks a frame waits in tx buffer, control channel frames are always sent at once */
+#ifndef CMUX_TX_FLUSH_TIME
+#define CMUX_TX_FLUSH_TIME       1
+#endif
+#elif defined(CMUX_USING_ADVANCED_OPTION)
+/* every byte of a frame may be escaped into two in advanced option */
+#define CMUX_TX_BUFFER_SIZE      ((CMUX_FRAME_SIZE_MAX + CMUX_FRAME_OVERHEAD) * 2)
+#else
+#define CMUX_TX_BUFFER_SIZE      (CMUX_FRAME_SIZE_MAX + CMUX_FRAME_OVERHEAD)
+#endif
+
+#ifdef CMUX_USING_RX_COALESCE
+/* the bytes a channel gets before rx_indicate, less data waits at most CMUX_RX_NOTIFY_TIME ticks */
+#ifndef CMUX_RX_NOTIFY_THRESHOLD
+#define CMUX_RX_NOTIFY_THRESHOLD 1
+#endif
+#ifndef CMUX_RX_NOTIFY_TIME
+#define CMUX_RX_NOTIFY_TIME      1
+#endif
+#endif
+
+/* the frame list length of a channel to ask the modem to stop sending on it by MSC with FC bit, and to resume it */
+#ifndef CMUX_FLOW_HIGH_WATER
+#define CMUX_FLOW_HIGH_WATER     (CMUX_MAX_FRAME_LIST_LEN * 3 / 4)
+#endif
+#ifndef CMUX_FLOW_LOW_WATER
+#define CMUX_FLOW_LOW_WATER      (CMUX_MAX_FRAME_LIST_LEN / 4)
+#endif
+
+#ifdef CMUX_USING_RX_ZERO_COPY
+/* frames queued in zero copy mode stay in cmux buffer, the budgets are clamped to 3/4 of it, so flow control
+ * and dropping start before the buffer fills up, the rest is left for the frames of control channel */
+#define CMUX_RX_BYTES_LIMIT      (CMUX_BUFFER_SIZE / 4 * 3)
+#endif
+
+/* the byte budget of frames queued for a channel and for the whole cmux object, a channel can queue full frames by default */
+#ifndef CMUX_VCOM_RX_BYTES_MAX
+#ifdef CMUX_USING_RX_ZERO_COPY
+#define CMUX_VCOM_RX_BYTES_MAX   CMUX_RX_BYTES_LIMIT
+#else
+#define CMUX_VCOM_RX_BYTES_MAX   (CMUX_FRAME_SIZE_MAX * (CMUX_MAX_FRAME_LIST_LEN + 1))
+#endif
+#endif
+#ifndef CMUX_RX_BYTES_MAX
+#ifdef CMUX_USING_RX_ZERO_COPY
+#define CMUX_RX_BYTES_MAX        CMUX_RX_BYTES_LIMIT
+#else
+#define CMUX_RX_BYTES_MAX        (CMUX_VCOM_RX_BYTES_MAX * 2)
+#endif
+#endif
+
+/* the byte fifo of a virtual serial attached with RT_DEVICE_FLAG_INT_RX, frame data is read across frame boundaries */
+#ifndef CMUX_VCOM_FIFO_SIZE
+#define CMUX_VCOM_FIFO_SIZE      (CMUX_FRAME_SIZE_MAX * 2)
+#endif
+
+/* the mode of AT+CMUX, it decides the framing */
+#define CMUX_MODE_BASIC               0               /* 0xF9 flags and length field */
+#define CMUX_MODE_ADVANCED            1               /* 0x7E flags and 0x7D escaping, CMUX_USING_ADVANCED_OPTION */
+
+/* error recovery mode: k is at most 7 as the sequence numbers are modulo 8, T1 and N2 take the defaults of 27.010 */
+#define CMUX_ERM_WINDOW_MAX           7
+#ifndef CMUX_ERM_T1
+#define CMUX_ERM_T1              (RT_TICK_PER_SECOND / 10)
+#endif
+#ifndef CMUX_ERM_RETRIES
+#define CMUX_ERM_RETRIES         3
+#endif
+
+/* what a channel does when its frame list reaches the limits */
+#define CMUX_RX_POLICY_DROP_NEWEST    0               /* drop the incoming frame */
+#define CMUX_RX_POLICY_DROP_OLDEST    1               /* drop the oldest frames of the channel to make room */
+#define CMUX_RX_POLICY_FLOW_CONTROL   2               /* stop the modem by MSC with FC bit near the limits, drop the incoming frame when full */
+
+/* the max ticks a write waits while the modem stops the channel by flow control */
+#ifndef CMUX_FLOW_WAIT_TIME
+#define CMUX_FLOW_WAIT_TIME      RT_WAITING_FOREVER
+#endif
+
+/* SABM and DISC are sent again when neither UA nor DM arrives in T1, the channel fails after N2 retries */
+#ifndef CMUX_DLC_T1
+#define CMUX_DLC_T1              (RT_TICK_PER_SECOND / 3)
+#endif
+#ifndef CMUX_DLC_RETRIES
+#define CMUX_DLC_RETRIES         3
+#endif
+
+/* the state of data link connection of a channel */
+#define CMUX_DLC_CLOSED          0
+#define CMUX_DLC_OPENING         1                        /* SABM has been sent, waiting for UA */
+#define CMUX_DLC_OPEN            2
+#define CMUX_DLC_CLOSING         3                        /* DISC has been sent, waiting for UA */
+#define CMUX_DLC_FAILED          4                        /* the modem answered DM to SABM, or didn't answer after N2 retries */
+
+/* the bytes a channel can send in its turn of round robin, multiplied by its weight */
+#ifndef CMUX_TX_QUANTUM
+#define CMUX_TX_QUANTUM          256
+#endif
+
+/* cmux_control command */
+#define CMUX_CTRL_SET_TX_FLUSH_TIME   0x01            /* rt_tick_t *, 0 means flushing every frame */
+#define CMUX_CTRL_SET_FRAME_SIZE      0x02            /* rt_uint32_t *, N1 of the AT+CMUX command */
+#define CMUX_CTRL_GET_STAT            0x03            /* struct cmux_stat *, counters of cmux object */
+#define CMUX_CTRL_GET_VCOM_STAT       0x04            /* struct cmux_vcom_stat *, counters of the port set in it */
+#define CMUX_CTRL_RESET_STAT          0x05            /* RT_NULL, clear all counters */
+#define CMUX_CTRL_SET_FLOW_WAIT_TIME  0x06            /* rt_int32_t *, 0 means returning the length has been sent at once */
+#define CMUX_CTRL_SET_TX_PRIORITY     0x07            /* struct cmux_tx_priority *, the priority and weight of a data channel */
+#define CMUX_CTRL_SET_RX_POLICY       0x08            /* struct cmux_rx_policy *, the overflow policy and byte budget of a channel */
+#define CMUX_CTRL_SET_RX_BYTES_MAX    0x09            /* rt_uint32_t *, the byte budget of frames queued for all channels */
+#define CMUX_CTRL_SET_RX_THRESHOLD    0x0A            /* struct cmux_rx_threshold *, the bytes a channel gets before rx_indicate */
+#define CMUX_CTRL_SET_RX_NOTIFY_TIME  0x0B            /* rt_tick_t *, the max ticks data below rx threshold waits, 0 means no waiting */
+#define CMUX_CTRL_SET_RECV_PRIORITY   0x0C            /* rt_uint8_t *, the priority of receive thread */
+#define CMUX_CTRL_SET_MODE            0x0D            /* rt_uint8_t *, CMUX_MODE_xxx, set it before multiplexer mode starts */
+#define CMUX_CTRL_SET_ERROR_RECOVERY  0x0E            /* struct cmux_erm_cfg *, k, T1 and N2 of error recovery mode, set it after CMUX_CTRL_SET_MODE */
+
+/* rt_device_control command of virtual serial */
+#define CMUX_VCOM_CTRL_SET_RX_TIMEOUT 0x20            /* rt_int32_t *, the max ticks a read waits for data, 0 by default means no waiting */
+#define CMUX_VCOM_CTRL_SET_TX_TIMEOUT 0x21            /* rt_int32_t *, the max ticks a write waits for flow control, CMUX_CTRL_SET_FLOW_WAIT_TIME by default */
+#define CMUX_VCOM_CTRL_SET_FRAME_SIZE 0x22            /* rt_uint32_t *, N1 asked for by PN on the next open, 0 means PN isn't sent */
+#define CMUX_VCOM_CTRL_GET_FRAME_SIZE 0x23            /* rt_uint32_t *, N1 of the channel, it is negotiated by PN or N1 of the object */
+#define CMUX_VCOM_CTRL_GET_STATE      0x24            /* rt_uint32_t *, CMUX_DLC_xxx */
+#define CMUX_VCOM_CTRL_WAIT_OPEN      0x25            /* rt_int32_t *, the max ticks waiting for UA of the channel */
+
+#ifdef CMUX_USING_FRAME_POOL
+/* frame data blocks are split into three size classes, the number of blocks is counted by port */
+#ifndef CMUX_POOL_SMALL_SIZE
+#define CMUX_POOL_SMALL_SIZE     128
+#endif
+#ifndef CMUX_POOL_SMALL_NUM
+#define CMUX_POOL_SMALL_NUM      (CMUX_MAX_FRAME_LIST_LEN + 2)
+#endif
+#ifndef CMUX_POOL_MEDIUM_SIZE
+#define CMUX_POOL_MEDIUM_SIZE    512
+#endif
+#ifndef CMUX_POOL_MEDIUM_NUM
+#define CMUX_POOL_MEDIUM_NUM     (CMUX_MAX_FRAME_LIST_LEN / 2 + 1)
+#endif
+#ifndef CMUX_POOL_LARGE_NUM
+#define CMUX_POOL_LARGE_NUM      2
+#endif
+#define CMUX_POOL_CLASS_NUM      3
 #endif
 
 #define CMUX_SW_VERSION           "1.1.0"
@@ -31,33 +252,200 @@ extern "C" {
 
 struct cmux_buffer
 {
-    rt_uint8_t data[CMUX_BUFFER_SIZE];                    /* cmux data buffer */
-    rt_uint8_t *read_point;
-    rt_uint8_t *write_point;
+    rt_uint8_t data[CMUX_BUFFER_SIZE];                    /* cmux data buffer, serial data is read into it and parsed in place */
+    int state;                                            /* the state of frame parser */
+    rt_uint8_t header[4];                                 /* address, control and length field of the frame being received */
+    rt_uint8_t header_length;                             /* the length of header has been received */
+    rt_uint8_t fcs;                                       /* the FCS of the frame being received, updated with every byte */
+    rt_bool_t dropped;                                    /* the frame being received will be dropped after checking */
+    int data_length;                                      /* the data length of the frame being received */
+    int data_offset;                                      /* the length of frame data has been received */
+    int frame_start;                                      /* the position of the frame being received in the bytes parsed again */
+    struct cmux_frame *rescan_frame;                      /* the frame dropped by FCS or end flag, its bytes are parsed again */
+    rt_uint8_t rescan_header[4];                          /* address, control and length field of rescan_frame */
+    rt_uint8_t rescan_header_length;
+    int rescan_length;                                    /* the length of frame data and FCS of rescan_frame to parse again */
+    int rescan_offset;                                    /* the position being parsed again, the header is counted in */
+#ifdef CMUX_USING_RX_ZERO_COPY
+    rt_uint8_t *rescan_point;                             /* frame data and FCS of rescan_frame in cmux buffer */
+#else
+    rt_uint8_t fcs_octet;                                 /* the FCS octet of the frame being received */
+    rt_uint8_t rescan_fcs;                                /* the FCS octet of rescan_frame when its end flag is wrong */
+#endif
+#ifdef CMUX_USING_ADVANCED_OPTION
+    rt_bool_t escaped;                                    /* advanced option, the last byte is the escape octet */
+    rt_bool_t pending_valid;                              /* advanced option, pending holds a byte */
+    rt_uint8_t pending;                                   /* advanced option, the last unescaped byte, it is FCS when a flag follows */
+#ifdef CMUX_USING_RX_ZERO_COPY
+    rt_uint8_t *adv_point;                                /* advanced option, the unescaped frame data is moved here in place */
+#else
+    rt_size_t adv_size;                                   /* advanced option, the room of frame data being unescaped */
+#endif
+#endif
+#ifdef CMUX_USING_RX_ZERO_COPY
+    rt_uint8_t *write_point;                              /* the next serial read starts here */
     rt_uint8_t *end_point;
-    int flag_found;                                       /* the flag whether you find cmux frame */
+    rt_uint8_t *hold_point;                               /* the oldest byte still referenced by a frame */
+    struct cmux_frame *hold_head;                         /* the oldest frame referencing the buffer */
+    struct cmux_frame *hold_tail;                         /* the newest frame referencing the buffer */
+    rt_bool_t stalled;                                    /* receive thread is waiting for buffer space */
+    rt_tick_t stall_tick;                                 /* the tick when the buffer got full */
+#endif
 };
 
 struct cmux_frame
 {
     rt_uint8_t channel;                                   /* the frame channel */
     rt_uint8_t control;                                   /* the type of frame */
+    rt_uint8_t cr;                                        /* C/R bit of address, it is 0 in the commands from the modem */
     int data_length;                                      /* frame length */
-    rt_uint8_t *data;                                     /* the point for cmux data */
+    rt_uint8_t *data;                                     /* the point for cmux data, it points into cmux_buffer in zero copy mode */
+
+    rt_list_t list;                                       /* list node for different virtual serial */
+#ifdef CMUX_USING_RX_ZERO_COPY
+    rt_bool_t released;                                   /* the consumer has drained this frame */
+    struct cmux_frame *hold_next;                         /* the next frame referencing the buffer */
+#endif
+};
+
+/* a frame waiting in the tx queue of channel, it lives on the stack of writer until it is sent */
+struct cmux_tx_request
+{
+    rt_list_t list;                                       /* node of the tx queue */
+    rt_uint8_t port;                                      /* the channel of frame */
+    rt_uint8_t type;                                      /* the type of frame */
+    const char *data;                                     /* frame data */
+    int length;                                           /* the length of frame data */
+    rt_size_t result;                                     /* the length has been sent */
+    rt_bool_t done;                                       /* the frame has been handled by the writer holding tx_lock */
+};
+
+/* threads sleep on it until the condition they check changes */
+struct cmux_waitq
+{
+    struct rt_semaphore sem;                              /* released once for every waiter by the waker */
+    rt_uint16_t waiters;                                  /* the number of threads sleeping on sem */
+};
+
+struct cmux_tx_priority
+{
+    rt_uint8_t port;                                      /* the data channel, control channel always has the highest priority */
+    rt_uint8_t priority;                                  /* smaller value is sent first, 0 by default */
+    rt_uint16_t weight;                                   /* the share of serial among channels of the same priority, 1 by default */
+};
+
+struct cmux_rx_policy
+{
+    rt_uint8_t port;                                      /* the channel */
+    rt_uint8_t policy;                                    /* CMUX_RX_POLICY_xxx, CMUX_RX_POLICY_FLOW_CONTROL by default */
+    rt_uint32_t bytes_max;                                /* the byte budget of the channel, 0 keeps the current budget */
+};
+
+struct cmux_rx_threshold
+{
+    rt_uint8_t port;                                      /* the data channel */
+    rt_uint32_t bytes;                                    /* rx_indicate is invoked when the channel gets so many bytes */
+};
+
+struct cmux_erm_cfg
+{
+    rt_uint8_t window;                                    /* k, the I frames waiting for acknowledgement, 0 means UIH frames are sent */
+    rt_uint8_t retries;                                   /* N2, the times T1 expires before the I frames are given up */
+    rt_tick_t t1;                                         /* T1, the ticks an I frame waits for acknowledgement */
 };
 
-struct frame
+#ifdef CMUX_USING_ERROR_RECOVERY
+/* an I frame sent, it is kept until the modem acknowledges it */
+struct cmux_erm_frame
 {
-    struct cmux_frame *frame;                             /* the point for cmux frame */
+    rt_uint8_t *data;                                     /* the copy of frame data */
+    int length;                                           /* the length of frame data */
+};
+
+/* the state of error recovery mode on a data channel, sequence numbers are modulo 8 */
+struct cmux_erm
+{
+    rt_uint8_t vs;                                        /* V(S), N(S) of the next new I frame */
+    rt_uint8_t va;                                        /* V(A), N(S) of the oldest I frame not acknowledged */
+    rt_uint8_t vr;                                        /* V(R), N(S) of the next I frame expected from the modem */
+    rt_uint8_t reserved;                                  /* room of window taken by writers whose frames haven't been sent */
+    rt_uint8_t retries;                                   /* T1 has expired so many times for the oldest I frame */
+    rt_bool_t peer_busy;                                  /* RNR received, the modem can't take I frames */
+    rt_bool_t rej_sent;                                   /* REJ sent, the I frames out of sequence are dropped silently */
+    rt_bool_t ack_pending;                                /* I frames received haven't been acknowledged */
+    rt_bool_t local_busy;                                 /* RNR sent, an I frame was dropped for lack of room */
+    rt_tick_t t1_start;                                   /* the tick when the I frames not acknowledged were sent */
+    struct cmux_erm_frame window[8];                      /* the I frames not acknowledged, indexed by N(S) */
+    rt_uint8_t *slab;                                     /* k blocks of CMUX_FRAME_SIZE_MAX bytes for the copies */
+    rt_uint8_t slot;                                      /* the block of slab for the next new I frame */
+};
+#endif
 
-    rt_slist_t frame_list;                                /* slist for different virtual serial */
+#ifdef CMUX_USING_FRAME_POOL
+struct cmux_pool
+{
+    rt_mp_t frame_mp;                                     /* blocks for struct cmux_frame */
+    rt_mp_t data_mp[CMUX_POOL_CLASS_NUM];                 /* blocks for frame data, sorted by block size */
+};
+#endif
+
+/* counters are updated without lock by the thread owning them, they are only for reading */
+struct cmux_stat
+{
+    rt_uint32_t tx_frames;                                /* frames have been sent */
+    rt_uint32_t tx_bytes;                                 /* frame data bytes have been sent */
+    rt_uint32_t tx_writes;                                /* rt_device_write calls for sending frames */
+    rt_uint32_t rx_frames;                                /* frames have been received */
+    rt_uint32_t rx_bytes;                                 /* bytes have been read from serial */
+    rt_uint32_t rx_wakeups;                               /* receive thread wakeups for reading serial */
+    rt_uint32_t rx_notifies;                              /* rx_indicate calls of serial, they are merged until receive thread reads serial */
+    rt_uint32_t rx_polls;                                 /* receive thread wakeups by polling */
+    rt_uint32_t rx_fcs_errors;                            /* frames dropped because FCS doesn't match */
+    rt_uint32_t rx_flag_errors;                           /* frames dropped because end flag isn't found */
+    rt_uint32_t rx_length_errors;                         /* frames dropped because they are longer than CMUX_FRAME_SIZE_MAX */
+    rt_uint32_t rx_channel_errors;                        /* frames dropped because their DLCI is out of CMUX_PORT_NUMBER */
+    rt_uint32_t rx_overflows;                             /* frame list is full, or cmux buffer is full in zero copy mode */
+    rt_uint32_t rx_overflow_bytes;                        /* frame data bytes dropped for lack of frame list or memory */
+    rt_uint32_t alloc_failures;                           /* frame or frame data allocation failed */
+    rt_uint32_t rx_allocs;                                /* frame and frame data allocations on receive path */
+    rt_uint32_t tx_flow_offs;                             /* FCoff received, the modem stops all data channels */
+    rt_uint32_t rx_flow_offs;                             /* FCoff sent, queued frames nearly use up the byte budget of object */
+    rt_uint32_t tx_retransmits;                           /* I frames sent again after REJ or T1 */
+    rt_uint32_t tx_rejects;                               /* REJ sent for I frames out of sequence */
+    rt_uint32_t rx_rejects;                               /* REJ received */
+    rt_uint32_t rx_sequence_errors;                       /* I frames dropped because they are out of sequence */
+    rt_uint32_t link_failures;                            /* I frames given up after N2 retransmissions */
+    rt_uint32_t dlc_retries;                              /* SABM or DISC sent again after T1 */
+    rt_uint32_t dlc_failures;                             /* channels refused by DM or not answered after N2 retries */
+};
+
+struct cmux_vcom_stat
+{
+    rt_uint8_t port;                                      /* the port of counters, set it before CMUX_CTRL_GET_VCOM_STAT */
+    rt_uint16_t queue_high;                               /* the high-water mark of frame list */
+    rt_uint32_t queue_bytes_high;                         /* the high-water mark of bytes queued in frame list */
+    rt_uint32_t rx_frames;                                /* frames have been pushed into frame list */
+    rt_uint32_t rx_bytes;                                 /* frame data bytes have been pushed into frame list */
+    rt_uint32_t rx_dropped;                               /* frames dropped because frame list is full */
+    rt_uint32_t rx_budget_drops;                          /* frames dropped because the byte budget of channel is used up */
+    rt_uint32_t rx_object_drops;                          /* frames dropped because the byte budget of object is used up */
+    rt_uint32_t rx_evicted;                               /* the oldest frames or fifo data dropped to make room, CMUX_RX_POLICY_DROP_OLDEST */
+    rt_uint32_t rx_indicates;                             /* rx_indicate calls */
+    rt_uint32_t tx_frames;                                /* frames have been sent */
+    rt_uint32_t tx_bytes;                                 /* frame data bytes have been sent */
+    rt_uint32_t tx_flow_offs;                             /* MSC with FC bit received, the modem stops this channel */
+    rt_uint32_t tx_flow_waits;                            /* writes have waited for flow control */
+    rt_uint32_t rx_flow_offs;                             /* MSC with FC bit sent, the frame list is nearly full */
+    rt_uint32_t tx_retransmits;                           /* I frames sent again after REJ or T1 */
 };
 
 struct cmux_vcoms
 {
     struct rt_device device;                              /* virtual device */
 
-    rt_slist_t flist;                                     /* head of frame_list */
+    struct cmux *cmux;                                    /* the cmux object owning this virtual serial */
+
+    rt_list_t flist;                                      /* head of frame list, frames are appended at tail */
 
     rt_uint16_t frame_index;                              /* the length of flist */
 
@@ -67,9 +455,39 @@ struct cmux_vcoms
 
     struct cmux_frame *frame;
 
-    rt_size_t length;
+    rt_size_t length;                                     /* the length of frame data has been read */
+
+    struct rt_ringbuffer *fifo;                           /* frame data is appended into it in fifo mode, RT_NULL in frame mode */
+    rt_mutex_t fifo_lock;                                 /* the fifo is copied with it taken, interrupt is disabled only for counters */
+#ifdef CMUX_USING_RX_COALESCE
+    rt_size_t rx_pending;                                 /* the bytes have been queued since the last rx_indicate */
+    rt_size_t rx_threshold;                               /* the bytes the channel gets before rx_indicate */
+#endif
+
+    rt_bool_t tx_flow_off;                                /* the modem stops this channel by MSC with FC bit */
+    rt_bool_t rx_flow_off;                                /* we stop the modem sending on this channel by MSC with FC bit */
+    rt_uint8_t rx_policy;                                 /* what to do when frame list reaches the limits */
+    rt_size_t rx_queued;                                  /* the bytes of frames in flist */
+    rt_size_t rx_bytes_max;                               /* the byte budget of flist */
+    struct cmux_waitq rx_wait;                            /* readers wait on it for data */
+    rt_int32_t rx_timeout;                                /* the max ticks a read waits for data */
+
+    struct cmux_waitq tx_wait;                            /* writers wait on it while flow is off */
+    rt_int32_t tx_timeout;                                /* the max ticks a write waits for flow control */
+    rt_uint16_t frame_size;                               /* N1 negotiated by PN, 0 means N1 of the object is used */
+    rt_uint16_t pn_frame_size;                            /* N1 asked for by PN when the channel is opened, 0 means PN isn't sent */
+    rt_uint8_t dlc_state;                                 /* CMUX_DLC_xxx, writers wait while it is opening */
+    rt_uint8_t dlc_retries;                               /* SABM or DISC has been sent again for times */
+    rt_tick_t dlc_start;                                  /* the tick when SABM or DISC was sent */
+#ifdef CMUX_USING_ERROR_RECOVERY
+    struct cmux_erm erm;                                  /* error recovery mode, writers also wait for the room of window */
+#endif
+    rt_list_t tx_list;                                    /* frames waiting for sending, struct cmux_tx_request */
+    rt_uint8_t tx_priority;                               /* smaller value is sent first */
+    rt_uint16_t tx_weight;                                /* the quantum of round robin is tx_weight * CMUX_TX_QUANTUM */
+    int tx_deficit;                                       /* the bytes the channel can still send in its turn */
 
-    rt_uint8_t *data;
+    struct cmux_vcom_stat stat;                           /* statistics */
 };
 
 struct cmux
@@ -77,14 +495,53 @@ struct cmux
     struct rt_device *dev;                                /* device object */
     const struct cmux_ops *ops;                           /* cmux device ops interface */
     struct cmux_buffer *buffer;                           /* cmux buffer */
-    struct cmux_frame *frame;                             /* cmux frame point */
+    struct cmux_frame *frame;                             /* the frame being received */
+#ifdef CMUX_USING_FRAME_POOL
+    struct cmux_pool *pool;                               /* cmux frame memory pool */
+#endif
     rt_thread_t recv_tid;                                 /* receive thread point */
+    rt_bool_t rx_notified;                                /* receive thread has been notified, later rx_indicate of serial is merged */
+#ifdef CMUX_USING_RX_POLL
+    rt_int32_t rx_poll_time;                              /* the ticks between polls, 0 means waiting for rx_indicate */
+    rt_tick_t rx_poll_tick;                               /* the tick of the last poll */
+#endif
     rt_uint8_t vcom_num;                                  /* the cmux port number */
     struct cmux_vcoms *vcoms;                             /* array */
 
     struct rt_event *event;                               /* internal communication */
 
+    rt_mutex_t tx_lock;                                   /* the writer holding it sends frames for all writers */
+    rt_uint8_t tx_turn;                                   /* the channel having the turn of round robin */
+    rt_uint8_t *tx_buffer;                                /* assemble the whole frame for a single write */
+    rt_size_t tx_length;                                  /* the length of frames waiting in tx buffer */
+    rt_uint16_t frame_size;                               /* max data length of a frame (N1) */
+    rt_uint8_t mode;                                      /* CMUX_MODE_BASIC or CMUX_MODE_ADVANCED */
+    rt_timer_t dlc_timer;                                 /* T1 of the earliest channel waiting for UA */
+    struct cmux_waitq dlc_wait;                           /* threads wait on it for channels to be established */
+#ifdef CMUX_USING_ERROR_RECOVERY
+    struct cmux_erm_cfg erm_cfg;                          /* error recovery mode is off when its window is 0 */
+    rt_timer_t erm_timer;                                 /* T1 of the earliest channel waiting for acknowledgement */
+#endif
+#ifdef CMUX_USING_TX_BATCH
+    rt_timer_t tx_timer;                                  /* flush tx buffer when time is up */
+    rt_tick_t tx_flush_time;                              /* the max ticks a frame waits in tx buffer */
+#endif
+
+    rt_bool_t tx_flow_off;                                /* the modem stops all data channels by FCoff */
+    rt_int32_t flow_wait_time;                            /* the default tx_timeout of virtual serials */
+    rt_bool_t rx_flow_off;                                /* we stop the modem sending on all channels by FCoff */
+    rt_size_t rx_queued;                                  /* the bytes of frames queued for all channels */
+    rt_size_t rx_bytes_max;                               /* the byte budget of frames queued for all channels */
+#ifdef CMUX_USING_RX_COALESCE
+    rt_timer_t rx_timer;                                  /* notify the channels waiting for rx threshold when time is up */
+    rt_tick_t rx_notify_time;                             /* the max ticks data below rx threshold waits */
+    rt_bool_t rx_timer_active;                            /* rx timer has been started */
+#endif
+
+    struct cmux_stat stat;                                /* statistics */
+
     rt_slist_t list;                                      /* cmux list */
+    rt_uint8_t id;                                        /* the number of cmux object, its threads and control channel are named by it */
 
     void *user_data;                                      /* reserve */
 };
@@ -104,11 +561,27 @@ rt_err_t cmux_start(struct cmux *object);
 rt_err_t cmux_stop(struct cmux *object);
 rt_err_t cmux_attach(struct cmux *object, int port, const char *alias_name, rt_uint16_t flags, void *user_data);
 rt_err_t cmux_detach(struct cmux *object, const char *alias_name);
+rt_err_t cmux_control(struct cmux *object, int cmd, void *args);
+rt_err_t cmux_wait_open(struct cmux *object, rt_int32_t timeout);
+rt_err_t cmux_probe(struct cmux *object, rt_int32_t timeout);
 void cmux_at_cmd_cfg(uint8_t mode, uint8_t subset, uint32_t port_speed, uint32_t N1, uint32_t T1, uint32_t N2,
         uint32_t T2, uint32_t T3, uint32_t k);
 
 /* cmux_utils */
+#define CMUX_FCS_INIT 0xFF                                /* the initial value of FCS */
+#define CMUX_FCS_GOOD 0xCF                                /* the FCS over a right frame including its FCS field */
+
+extern const rt_uint8_t cmux_crctable[256];
+rt_uint8_t cmux_fcs_update(rt_uint8_t fcs, const rt_uint8_t *input, rt_size_t length);
 rt_uint8_t cmux_frame_check(const rt_uint8_t *input, int length);
+#ifdef CMUX_USING_ADVANCED_OPTION
+#define CMUX_ADV_FLAG   0x7E                              /* the flag of advanced option */
+#define CMUX_ADV_ESCAPE 0x7D                              /* the control escape octet, the next byte is XORed with CMUX_ADV_XOR */
+#define CMUX_ADV_XOR    0x20
+
+rt_size_t cmux_adv_scan(const rt_uint8_t *input, rt_size_t length);
+rt_size_t cmux_adv_escape(rt_uint8_t *output, const rt_uint8_t *input, rt_size_t length);
+#endif
 struct cmux *cmux_object_find(const char *name);
 
 #ifdef  __cplusplus
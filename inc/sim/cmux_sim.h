@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2006-2026, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-17     agent          the first version
+ */
+
+#ifndef __CMUX_SIM_H__
+#define __CMUX_SIM_H__
+
+#include <rtthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the device name of simulated modem, set CMUX_DEPEND_NAME to it */
+#ifndef CMUX_SIM_NAME
+#define CMUX_SIM_NAME "cmux_sim"
+#endif
+
+rt_err_t cmux_sim_inject(const void *buffer, rt_size_t size);
+void cmux_sim_set_loss(rt_uint32_t rx_every, rt_uint32_t tx_every);
+
+#ifdef  __cplusplus
+    }
+#endif
+
+#endif  /* __CMUX_SIM_H__ */
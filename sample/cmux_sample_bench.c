@@ -0,0 +1,550 @@
+/*
+ * Copyright (c) 2006-2026, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-17     agent          the first version, throughput and latency bench
+ */
+
+#include <cmux.h>
+#include <rtthread.h>
+#include <stdlib.h>
+
+#define DBG_TAG "cmux.bench"
+
+#ifdef CMUX_DEBUG
+#define DBG_LVL DBG_LOG
+#else
+#define DBG_LVL DBG_INFO
+#endif
+
+#include <rtdbg.h>
+
+#define min(a, b) ((a) <= (b) ? (a) : (b))
+
+#define CMUX_BENCH_FCS_LEN     CMUX_FRAME_SIZE_MAX
+#define CMUX_BENCH_FCS_LOOP    1000
+
+/* the FCS loop used before cmux_fcs_update(), one table lookup per byte */
+static rt_uint8_t cmux_bench_fcs_table(rt_uint8_t fcs, const rt_uint8_t *input, rt_size_t length)
+{
+    while (length--)
+    {
+        fcs = cmux_crctable[fcs ^ *input++];
+    }
+    return fcs;
+}
+
+/* bytes per second, the ticks are at least one */
+static rt_uint32_t cmux_bench_rate(rt_uint32_t bytes, rt_tick_t ticks)
+{
+    return (rt_uint32_t)((rt_uint64_t)bytes * RT_TICK_PER_SECOND / (ticks ? ticks : 1));
+}
+
+/**
+ * compare the FCS engine with the per-byte table loop over frame size data
+ *
+ * usage: cmux_fcs_bench [loop]
+ */
+static int cmux_fcs_bench(int argc, char **argv)
+{
+    rt_uint8_t *data = RT_NULL;
+    rt_uint8_t fcs_table = CMUX_FCS_INIT, fcs_engine = CMUX_FCS_INIT;
+    rt_uint32_t loop = CMUX_BENCH_FCS_LOOP, i;
+    rt_tick_t tick_table, tick_engine;
+
+    if (argc > 1)
+    {
+        loop = atoi(argv[1]);
+    }
+
+    data = rt_malloc(CMUX_BENCH_FCS_LEN);
+    if (data == RT_NULL)
+    {
+        LOG_E("cmux fcs bench malloc failed.");
+        return -RT_ENOMEM;
+    }
+    for (i = 0; i < CMUX_BENCH_FCS_LEN; i++)
+    {
+        data[i] = (rt_uint8_t)(i * 31 + 7);
+    }
+
+    tick_table = rt_tick_get();
+    for (i = 0; i < loop; i++)
+    {
+        fcs_table = cmux_bench_fcs_table(fcs_table, data, CMUX_BENCH_FCS_LEN);
+    }
+    tick_table = rt_tick_get() - tick_table;
+
+    tick_engine = rt_tick_get();
+    for (i = 0; i < loop; i++)
+    {
+        fcs_engine = cmux_fcs_update(fcs_engine, data, CMUX_BENCH_FCS_LEN);
+    }
+    tick_engine = rt_tick_get() - tick_engine;
+
+    rt_free(data);
+
+    if (fcs_table != fcs_engine)
+    {
+        LOG_E("cmux fcs bench result mismatch: 0x%02x != 0x%02x.", fcs_table, fcs_engine);
+        return -RT_ERROR;
+    }
+
+    rt_kprintf("fcs bytes: %u\n", loop * CMUX_BENCH_FCS_LEN);
+    rt_kprintf("fcs table : %u ticks, %u B/s\n", tick_table, cmux_bench_rate(loop * CMUX_BENCH_FCS_LEN, tick_table));
+    rt_kprintf("fcs engine: %u ticks, %u B/s\n", tick_engine, cmux_bench_rate(loop * CMUX_BENCH_FCS_LEN, tick_engine));
+
+    return RT_EOK;
+}
+MSH_CMD_EXPORT(cmux_fcs_bench, compare cmux FCS engine with table loop);
+
+#ifdef CMUX_USING_ADVANCED_OPTION
+/* the escape loop of advanced option with a branch per byte */
+static rt_size_t cmux_bench_escape_byte(rt_uint8_t *output, const rt_uint8_t *input, rt_size_t length)
+{
+    rt_uint8_t *point = output;
+
+    while (length--)
+    {
+        if (*input == CMUX_ADV_FLAG || *input == CMUX_ADV_ESCAPE)
+        {
+            *point++ = CMUX_ADV_ESCAPE;
+            *point++ = *input++ ^ CMUX_ADV_XOR;
+        }
+        else
+        {
+            *point++ = *input++;
+        }
+    }
+    return point - output;
+}
+
+/**
+ * compare the escape scanner of advanced option with the per-byte loop, copying the data as basic option does
+ * is the baseline. the data has two flag or escape octets in every 256 bytes.
+ *
+ * usage: cmux_escape_bench [loop]
+ */
+static int cmux_escape_bench(int argc, char **argv)
+{
+    rt_uint8_t *data = RT_NULL, *output = RT_NULL;
+    rt_uint32_t loop = CMUX_BENCH_FCS_LOOP, i;
+    rt_size_t size_byte = 0, size_scan = 0;
+    rt_tick_t tick_copy, tick_byte, tick_scan;
+
+    if (argc > 1)
+    {
+        loop = atoi(argv[1]);
+    }
+
+    data = rt_malloc(CMUX_BENCH_FCS_LEN);
+    output = rt_malloc(CMUX_BENCH_FCS_LEN * 2);
+    if (data == RT_NULL || output == RT_NULL)
+    {
+        LOG_E("cmux escape bench malloc failed.");
+        rt_free(data);
+        rt_free(output);
+        return -RT_ENOMEM;
+    }
+    for (i = 0; i < CMUX_BENCH_FCS_LEN; i++)
+    {
+        data[i] = (rt_uint8_t)(i * 31 + 7);
+    }
+
+    tick_copy = rt_tick_get();
+    for (i = 0; i < loop; i++)
+    {
+        rt_memcpy(output, data, CMUX_BENCH_FCS_LEN);
+    }
+    tick_copy = rt_tick_get() - tick_copy;
+
+    tick_byte = rt_tick_get();
+    for (i = 0; i < loop; i++)
+    {
+        size_byte = cmux_bench_escape_byte(output, data, CMUX_BENCH_FCS_LEN);
+    }
+    tick_byte = rt_tick_get() - tick_byte;
+
+    tick_scan = rt_tick_get();
+    for (i = 0; i < loop; i++)
+    {
+        size_scan = cmux_adv_escape(output, data, CMUX_BENCH_FCS_LEN);
+    }
+    tick_scan = rt_tick_get() - tick_scan;
+
+    rt_free(data);
+    rt_free(output);
+
+    if (size_byte != size_scan)
+    {
+        LOG_E("cmux escape bench result mismatch: %d != %d.", (int)size_byte, (int)size_scan);
+        return -RT_ERROR;
+    }
+
+    rt_kprintf("escape bytes: %u, escaped length: %u\n", loop * CMUX_BENCH_FCS_LEN, (rt_uint32_t)size_scan);
+    rt_kprintf("escape copy : %u ticks, %u B/s\n", tick_copy, cmux_bench_rate(loop * CMUX_BENCH_FCS_LEN, tick_copy));
+    rt_kprintf("escape byte : %u ticks, %u B/s\n", tick_byte, cmux_bench_rate(loop * CMUX_BENCH_FCS_LEN, tick_byte));
+    rt_kprintf("escape scan : %u ticks, %u B/s\n", tick_scan, cmux_bench_rate(loop * CMUX_BENCH_FCS_LEN, tick_scan));
+
+    return RT_EOK;
+}
+MSH_CMD_EXPORT(cmux_escape_bench, compare cmux escape scanner with byte loop);
+#endif
+
+#ifdef CMUX_USING_SIM
+#include <cmux_sim.h>
+
+/**
+ * cmux_bench drives frames through the simulated modem, which echoes every data frame. the time is taken from
+ * cmux_vcom_write on the sending side to rx_indicate of the echoed frame, so both the tx framer and the rx parser
+ * are measured. the echoed frames are counted by the bytes read, one rx_indicate may stand for several frames.
+ * cmux must be started on CMUX_SIM_NAME with the sample channels attached.
+ */
+
+/* the clock of latency, define it as a cycle counter for finer results */
+#ifndef CMUX_BENCH_CLOCK
+#define CMUX_BENCH_CLOCK()     rt_tick_get()
+#define CMUX_BENCH_CLOCK_HZ    RT_TICK_PER_SECOND
+#endif
+
+#define CMUX_BENCH_FRAMES      1000
+#define CMUX_BENCH_TIMEOUT     (RT_TICK_PER_SECOND * 2)
+/* frames on the way, the echo of them must fit in the buffer of simulated modem and in the frame list of channel,
+ * a coalesced rx_indicate comes only after a whole batch is queued */
+#ifndef CMUX_BENCH_WINDOW
+#define CMUX_BENCH_WINDOW      2
+#endif
+
+#define CMUX_BENCH_AT_NAME     "cmux_at"
+#define CMUX_BENCH_PPP_NAME    "cmux_ppp"
+
+#define CMUX_BENCH_N1          ((rt_uint16_t)-1)    /* the frame size of cmux object */
+#define CMUX_BENCH_WRAP        ((rt_uint16_t)-2)    /* a third of cmux buffer, frames wrap around the end of it */
+
+struct cmux_bench_case
+{
+    const char *name;
+    rt_uint16_t at_size;                                  /* data length of frames on AT channel, 0 means unused */
+    rt_uint16_t ppp_size;                                 /* data length of frames on PPP channel, 0 means unused */
+    rt_uint16_t fcs_error;                                /* a broken frame is injected every fcs_error frames */
+};
+
+struct cmux_bench_channel
+{
+    rt_device_t device;
+    rt_bool_t opened;                                     /* the device has been opened by the bench */
+    rt_err_t (*rx_indicate)(rt_device_t dev, rt_size_t size);
+    rt_uint32_t *tx_time;                                 /* the time each frame is written */
+    rt_uint32_t sent;
+    rt_uint32_t received;
+    rt_uint16_t size;                                     /* the data length of frames in this case */
+    rt_uint32_t rx_bytes;                                 /* the bytes read of the frame being echoed */
+};
+
+static const struct cmux_bench_case cmux_bench_cases[] =
+{
+    /* name     AT    PPP              fcs_error */
+    {"at",      16,   0,               0},
+    {"ppp",     0,    1500,            0},
+    {"n1",      0,    CMUX_BENCH_N1,   0},
+    {"mixed",   16,   1500,            0},
+    {"fcs",     0,    1500,            8},
+    {"wrap",    0,    CMUX_BENCH_WRAP, 0},
+};
+
+static struct cmux_bench_channel cmux_bench_channels[2];
+static struct rt_semaphore cmux_bench_sem;
+static rt_uint32_t *cmux_bench_latency = RT_NULL;
+static rt_uint32_t cmux_bench_done;
+static rt_uint8_t cmux_bench_buffer[CMUX_FRAME_SIZE_MAX];
+
+/* it is invoked by receive thread of cmux when echoed frames are queued */
+static rt_err_t cmux_bench_rx_ind(rt_device_t dev, rt_size_t size)
+{
+    rt_uint32_t now = CMUX_BENCH_CLOCK();
+    struct cmux_bench_channel *channel = &cmux_bench_channels[dev == cmux_bench_channels[0].device ? 0 : 1];
+    rt_size_t len;
+
+    /* consume the data like an application */
+    while ((len = rt_device_read(dev, 0, cmux_bench_buffer, sizeof(cmux_bench_buffer))) > 0)
+    {
+        channel->rx_bytes += len;
+    }
+
+    /* every frame echoed in full is counted */
+    while (channel->size > 0 && channel->rx_bytes >= channel->size)
+    {
+        channel->rx_bytes -= channel->size;
+        if (channel->received < channel->sent)
+        {
+            cmux_bench_latency[cmux_bench_done++] = now - channel->tx_time[channel->received];
+        }
+        channel->received++;
+        rt_sem_release(&cmux_bench_sem);
+    }
+
+    return RT_EOK;
+}
+
+static int cmux_bench_compare(const void *a, const void *b)
+{
+    rt_uint32_t x = *(const rt_uint32_t *)a, y = *(const rt_uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* clock to microsecond */
+static rt_uint32_t cmux_bench_us(rt_uint32_t clock)
+{
+    return (rt_uint32_t)((rt_uint64_t)clock * 1000000 / CMUX_BENCH_CLOCK_HZ);
+}
+
+/* a UIH frame of PPP channel with wrong FCS */
+static void cmux_bench_inject_error(struct cmux *cmux)
+{
+    rt_uint8_t frame[] = {0xF9, 0x07, 0xEF, (8 << 1) | 1, 0, 1, 2, 3, 4, 5, 6, 7, 0, 0xF9};
+
+#ifdef CMUX_USING_ADVANCED_OPTION
+    if (cmux->mode == CMUX_MODE_ADVANCED)
+    {
+        /* advanced option has no length field, FCS is chosen to need no escaping */
+        rt_uint8_t adv_frame[] = {CMUX_ADV_FLAG, 0x07, 0xEF, 0, 1, 2, 3, 4, 5, 6, 7, 0, CMUX_ADV_FLAG};
+
+        adv_frame[11] = cmux_frame_check(adv_frame + 1, 2) ^ 0x01;
+        cmux_sim_inject(adv_frame, sizeof(adv_frame));
+        return;
+    }
+#endif
+    frame[12] = cmux_frame_check(frame + 1, 3) ^ 0x55;
+    cmux_sim_inject(frame, sizeof(frame));
+}
+
+/**
+ * run one traffic case, the result is printed as a line of JSON
+ *
+ * @param cmux          cmux object on simulated modem
+ * @param bench         the traffic case
+ * @param frames        the number of frames
+ *
+ * @return  RT_EOK      all frames are echoed
+ *          -RT_ETIMEOUT frames are lost
+ */
+static rt_err_t cmux_bench_run(struct cmux *cmux, const struct cmux_bench_case *bench, rt_uint32_t frames)
+{
+    struct cmux_bench_channel *channel = RT_NULL;
+    struct cmux_stat start_stat, end_stat;
+    rt_uint16_t size, sizes[2] = {bench->at_size, bench->ppp_size};
+    rt_uint32_t i, bytes = 0, start, elapsed, allocs, rx_bytes, sent, p50 = 0, p99 = 0;
+    rt_err_t result = RT_EOK;
+
+    for (i = 0; i < 2; i++)
+    {
+        if (sizes[i] == CMUX_BENCH_N1)
+            sizes[i] = cmux->frame_size;
+        else if (sizes[i] == CMUX_BENCH_WRAP)
+            sizes[i] = min(CMUX_BUFFER_SIZE / 3 + 1, cmux->frame_size);
+        else
+            sizes[i] = min(sizes[i], cmux->frame_size);
+        cmux_bench_channels[i].sent = 0;
+        cmux_bench_channels[i].received = 0;
+        cmux_bench_channels[i].size = sizes[i];
+        cmux_bench_channels[i].rx_bytes = 0;
+    }
+    cmux_bench_done = 0;
+    rt_sem_control(&cmux_bench_sem, RT_IPC_CMD_RESET, (void *)CMUX_BENCH_WINDOW);
+    cmux_control(cmux, CMUX_CTRL_GET_STAT, &start_stat);
+
+    start = CMUX_BENCH_CLOCK();
+    for (i = 0; i < frames; i++)
+    {
+        /* channels take turns when both are used */
+        channel = &cmux_bench_channels[(sizes[0] == 0 || (sizes[1] != 0 && (i & 1))) ? 1 : 0];
+        size = sizes[channel - cmux_bench_channels];
+
+        if (rt_sem_take(&cmux_bench_sem, CMUX_BENCH_TIMEOUT) != RT_EOK)
+        {
+            result = -RT_ETIMEOUT;
+            break;
+        }
+        channel->tx_time[channel->sent++] = CMUX_BENCH_CLOCK();
+        rt_device_write(channel->device, 0, cmux_bench_buffer, size);
+        bytes += size;
+
+        if (bench->fcs_error && i % bench->fcs_error == 0)
+        {
+            cmux_bench_inject_error(cmux);
+        }
+    }
+    /* wait for the frames on the way */
+    for (i = 0; i < CMUX_BENCH_WINDOW && result == RT_EOK; i++)
+    {
+        if (rt_sem_take(&cmux_bench_sem, CMUX_BENCH_TIMEOUT) != RT_EOK)
+        {
+            result = -RT_ETIMEOUT;
+        }
+    }
+    elapsed = CMUX_BENCH_CLOCK() - start;
+    elapsed = elapsed ? elapsed : 1;
+    cmux_control(cmux, CMUX_CTRL_GET_STAT, &end_stat);
+
+    sent = cmux_bench_channels[0].sent + cmux_bench_channels[1].sent;
+    if (cmux_bench_done > 0)
+    {
+        qsort(cmux_bench_latency, cmux_bench_done, sizeof(rt_uint32_t), cmux_bench_compare);
+        p50 = cmux_bench_latency[cmux_bench_done / 2];
+        p99 = cmux_bench_latency[cmux_bench_done * 99 / 100];
+    }
+    allocs = end_stat.rx_allocs - start_stat.rx_allocs;
+    rx_bytes = end_stat.rx_bytes - start_stat.rx_bytes;
+    frames = cmux_bench_done ? cmux_bench_done : 1;
+
+    rt_kprintf("{\"case\":\"%s\",\"frames\":%u,\"lost\":%u,\"bytes\":%u,\"time_us\":%u,\"bytes_per_sec\":%u,"
+               "\"ns_per_frame\":%u,\"allocs_per_frame\":%u.%02u,\"p50_us\":%u,\"p99_us\":%u,\"fcs_errors\":%u,\"tx_writes\":%u,"
+               "\"wakeups_per_mb\":%u}\n",
+               bench->name, cmux_bench_done, sent - cmux_bench_done, bytes, cmux_bench_us(elapsed),
+               (rt_uint32_t)((rt_uint64_t)bytes * CMUX_BENCH_CLOCK_HZ / elapsed),
+               (rt_uint32_t)((rt_uint64_t)elapsed * 1000000000 / CMUX_BENCH_CLOCK_HZ / frames),
+               allocs / frames, allocs * 100 / frames % 100,
+               cmux_bench_us(p50), cmux_bench_us(p99),
+               end_stat.rx_fcs_errors - start_stat.rx_fcs_errors, end_stat.tx_writes - start_stat.tx_writes,
+               rx_bytes ? (rt_uint32_t)((rt_uint64_t)(end_stat.rx_wakeups - start_stat.rx_wakeups) * 1048576 / rx_bytes) : 0);
+
+    return result;
+}
+
+/**
+ * benchmark cmux with the traffic cases through simulated modem
+ *
+ * usage: cmux_bench [frames] [case]
+ */
+static int cmux_bench(int argc, char **argv)
+{
+    const char *names[2] = {CMUX_BENCH_AT_NAME, CMUX_BENCH_PPP_NAME};
+    struct cmux *cmux = RT_NULL;
+    rt_uint32_t frames = CMUX_BENCH_FRAMES;
+    rt_err_t result = RT_EOK;
+    int i;
+
+    if (argc > 1)
+    {
+        frames = atoi(argv[1]);
+    }
+    cmux = cmux_object_find(CMUX_SIM_NAME);
+    if (cmux == RT_NULL || frames == 0)
+    {
+        LOG_E("cmux bench needs cmux started on %s.", CMUX_SIM_NAME);
+        return -RT_ERROR;
+    }
+
+    cmux_bench_latency = rt_malloc(frames * sizeof(rt_uint32_t));
+    cmux_bench_channels[0].tx_time = rt_malloc(frames * sizeof(rt_uint32_t));
+    cmux_bench_channels[1].tx_time = rt_malloc(frames * sizeof(rt_uint32_t));
+    if (cmux_bench_latency == RT_NULL || cmux_bench_channels[0].tx_time == RT_NULL || cmux_bench_channels[1].tx_time == RT_NULL)
+    {
+        LOG_E("cmux bench malloc failed.");
+        result = -RT_ENOMEM;
+        goto __exit;
+    }
+    rt_sem_init(&cmux_bench_sem, "cmux_bch", CMUX_BENCH_WINDOW, RT_IPC_FLAG_FIFO);
+
+    for (i = 0; i < 2; i++)
+    {
+        cmux_bench_channels[i].device = RT_NULL;
+        cmux_bench_channels[i].opened = RT_FALSE;
+    }
+    for (i = 0; i < 2; i++)
+    {
+        cmux_bench_channels[i].device = rt_device_find(names[i]);
+        if (cmux_bench_channels[i].device == RT_NULL)
+        {
+            LOG_E("cmux bench can't find %s.", names[i]);
+            result = -RT_ERROR;
+            goto __detach;
+        }
+        if (rt_device_open(cmux_bench_channels[i].device, RT_DEVICE_OFLAG_RDWR) != RT_EOK)
+        {
+            LOG_E("cmux bench can't open %s.", names[i]);
+            result = -RT_ERROR;
+            goto __detach;
+        }
+        cmux_bench_channels[i].opened = RT_TRUE;
+        cmux_bench_channels[i].rx_indicate = cmux_bench_channels[i].device->rx_indicate;
+        rt_device_set_rx_indicate(cmux_bench_channels[i].device, cmux_bench_rx_ind);
+    }
+    for (i = 0; i < CMUX_FRAME_SIZE_MAX; i++)
+    {
+        cmux_bench_buffer[i] = (rt_uint8_t)i;
+    }
+
+    rt_kprintf("{\"bench\":\"cmux\",\"version\":\"%s\",\"clock_hz\":%u,\"frame_size\":%u,\"buffer_size\":%u,\"mode\":\"%s\",\"options\":\"%s%s%s%s%s%s\"}\n",
+               CMUX_SW_VERSION, CMUX_BENCH_CLOCK_HZ, cmux->frame_size, CMUX_BUFFER_SIZE,
+               (cmux->mode == CMUX_MODE_ADVANCED) ? "advanced" : "basic",
+#ifdef CMUX_USING_RX_ZERO_COPY
+               "zero_copy ",
+#else
+               "",
+#endif
+#ifdef CMUX_USING_FRAME_POOL
+               "frame_pool ",
+#else
+               "",
+#endif
+#ifdef CMUX_USING_TX_BATCH
+               "tx_batch ",
+#else
+               "",
+#endif
+#ifdef CMUX_USING_RX_COALESCE
+               "rx_coalesce ",
+#else
+               "",
+#endif
+#ifdef CMUX_USING_RX_POLL
+               "rx_poll ",
+#else
+               "",
+#endif
+#if defined(CMUX_USING_FCS_SLICE_BY_8)
+               "fcs_slice_by_8"
+#elif defined(CMUX_USING_FCS_SLICE_BY_4)
+               "fcs_slice_by_4"
+#else
+               "fcs_table"
+#endif
+               );
+
+    for (i = 0; i < sizeof(cmux_bench_cases) / sizeof(cmux_bench_cases[0]) && result == RT_EOK; i++)
+    {
+        if (argc > 2 && rt_strcmp(argv[2], cmux_bench_cases[i].name) != 0)
+        {
+            continue;
+        }
+        result = cmux_bench_run(cmux, &cmux_bench_cases[i], frames);
+    }
+
+__detach:
+    for (i = 0; i < 2; i++)
+    {
+        if (cmux_bench_channels[i].opened)
+        {
+            rt_device_set_rx_indicate(cmux_bench_channels[i].device, cmux_bench_channels[i].rx_indicate);
+            rt_device_close(cmux_bench_channels[i].device);
+            cmux_bench_channels[i].opened = RT_FALSE;
+        }
+    }
+    rt_sem_detach(&cmux_bench_sem);
+__exit:
+    rt_free(cmux_bench_latency);
+    rt_free(cmux_bench_channels[0].tx_time);
+    rt_free(cmux_bench_channels[1].tx_time);
+    cmux_bench_latency = RT_NULL;
+    cmux_bench_channels[0].tx_time = RT_NULL;
+    cmux_bench_channels[1].tx_time = RT_NULL;
+
+    return result;
+}
+MSH_CMD_EXPORT(cmux_bench, benchmark cmux through simulated modem);
+#endif /* CMUX_USING_SIM */
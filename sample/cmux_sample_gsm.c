@@ -31,6 +31,8 @@ struct cmux *sample = RT_NULL;
 int cmux_sample(void)
 {
     rt_err_t result;
+    struct cmux_tx_priority priority = {CMUX_PPP_PORT, 1, 1};
+    struct cmux_rx_policy policy = {CMUX_AT_PORT, CMUX_RX_POLICY_DROP_OLDEST, 0};
 
     /* find cmux object through the actual serial name < the actual serial has been related in the cmux.c file > */
     sample = cmux_object_find(CMUX_DEPEND_NAME);
@@ -66,6 +68,11 @@ int cmux_sample(void)
         goto end;
     }
     LOG_I("cmux object channel (%s) attach successful.", CMUX_PPP_NAME);
+
+    /* AT commands are sent before bulk PPP data */
+    cmux_control(sample, CMUX_CTRL_SET_TX_PRIORITY, &priority);
+    /* unread URCs on AT channel don't pin memory, only the newest ones are kept */
+    cmux_control(sample, CMUX_CTRL_SET_RX_POLICY, &policy);
 end:
     return RT_EOK;
 }
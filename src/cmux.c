@@ -10,6 +10,7 @@
 
 #include <cmux.h>
 #include <rtthread.h>
+#include <rtdevice.h>
 #include <rthw.h>
 
 // bits: Poll/final, Command/Response, Extension
@@ -23,11 +24,33 @@
 #define CMUX_FRAME_DISC 67
 #define CMUX_FRAME_UIH 239
 #define CMUX_FRAME_UI 3
+// the frames of error recovery mode, N(S) and N(R) are kept in the control field
+#define CMUX_FRAME_I 0
+#define CMUX_FRAME_RR 1
+#define CMUX_FRAME_RNR 5
+#define CMUX_FRAME_REJ 9
 // the types of the control channel commands
 #define CMUX_C_CLD 193
 #define CMUX_C_TEST 33
 #define CMUX_C_MSC 225
 #define CMUX_C_NSC 17
+#define CMUX_C_FCON 161
+#define CMUX_C_FCOFF 97
+#define CMUX_C_PSC 65
+#define CMUX_C_PN 129
+// bits of V.24 signals in MSC: Flow Control, Ready To Communicate, Ready To Receive, Data Valid
+#define CMUX_MSC_FC 2
+#define CMUX_MSC_RTC 4
+#define CMUX_MSC_RTR 8
+#define CMUX_MSC_DV 128
+// the values of PN: DLCI, frame type and convergence layer, priority, T1, N1(2 bytes), N2, k
+#define CMUX_PN_LENGTH 8
+#define CMUX_PN_TYPE_UIH 0
+#define CMUX_PN_TYPE_I 2
+#define CMUX_PN_PRIORITY_MAX 63
+#define CMUX_PN_T1_DEFAULT 10           /* 100 ms */
+#define CMUX_PN_N2_DEFAULT 3
+#define CMUX_PN_K_DEFAULT 2
 // basic mode flag for frame start and end
 #define CMUX_HEAD_FLAG (unsigned char)0xF9
 
@@ -38,35 +61,65 @@
 #define CMUX_COMMAND_IS(command, type) ((type & ~CMUX_ADDRESS_CR) == command)
 #define CMUX_PF_ISSET(frame) ((frame->control & CMUX_CONTROL_PF) == CMUX_CONTROL_PF)
 #define CMUX_FRAME_IS(type, frame) ((frame->control & ~CMUX_CONTROL_PF) == type)
+/* FCS covers frame data of UI and I frames */
+#define CMUX_FCS_COVERS_DATA(control) ((((control) & ~CMUX_CONTROL_PF) == CMUX_FRAME_UI) || (((control) & 1) == 0))
 
-#define min(a, b) ((a) <= (b) ? (a) : (b))
-
-/* increases buffer pointer by one and wraps around if necessary */
-#define INC_BUF_POINTER(buf, p)  \
-    (p)++;                       \
-    if ((p) == (buf)->end_point) \
-        (p) = (buf)->data;
+#define CMUX_ERM_SEQ(n) ((n) & 7)
+#define CMUX_ERM_NS(control) (((control) >> 1) & 7)
+#define CMUX_ERM_NR(control) (((control) >> 5) & 7)
 
-/* Tells, how many chars are saved into the buffer */
-#define cmux_buffer_length(buff) (((buff)->read_point > (buff)->write_point) ? (CMUX_BUFFER_SIZE - ((buff)->read_point - (buff)->write_point)) : ((buff)->write_point - (buff)->read_point))
+#define min(a, b) ((a) <= (b) ? (a) : (b))
+#define max(a, b) ((a) >= (b) ? (a) : (b))
 
-/* Tells, how much free space there is in the buffer */
-#define cmux_buffer_free(buff) (((buff)->read_point > (buff)->write_point) ? ((buff)->read_point - (buff)->write_point) : (CMUX_BUFFER_SIZE - ((buff)->write_point - (buff)->read_point)))
+#ifdef CMUX_USING_RX_ZERO_COPY
+/* Tells, how many chars are between two points of the buffer */
+#define cmux_buffer_distance(from, to) (((from) > (to)) ? (CMUX_BUFFER_SIZE - ((from) - (to))) : ((to) - (from)))
 
-#define CMUX_THREAD_STACK_SIZE (CMUX_RECV_READ_MAX + 1536)
-#define CMUX_THREAD_PRIORITY 8
+/* Tells, how much free space there is in the buffer; one byte is kept to tell full from empty */
+#define cmux_buffer_free(buff) (CMUX_BUFFER_SIZE - 1 - cmux_buffer_distance((buff)->hold_point, (buff)->write_point))
+#endif
 
-#define CMUX_RECIEVE_RESET 0
-#define CMUX_RECIEVE_BEGIN 1
-#define CMUX_RECIEVE_PROCESS 2
-#define CMUX_RECIEVE_END 3
+/* the states of frame parser */
+#define CMUX_RECIEVE_RESET 0 /* hunting for the start flag */
+#define CMUX_RECIEVE_BEGIN 1 /* receiving address, control and length field */
+#define CMUX_RECIEVE_PROCESS 2 /* receiving frame data and FCS */
+#define CMUX_RECIEVE_END 3 /* waiting for the end flag */
 
 #define CMUX_EVENT_RX_NOTIFY 1 /* serial incoming a byte */
 #define CMUX_EVENT_CHANNEL_OPEN 2
 #define CMUX_EVENT_CHANNEL_CLOSE 4
-#define CMUX_EVENT_CHANNEL_OPEN_REQ 8
+#define CMUX_EVENT_CHANNEL_OPEN_REQ 8 /* T1 of SABM or DISC has expired */
 #define CMUX_EVENT_CHANNEL_CLOSE_REQ 16
 #define CMUX_EVENT_FUNCTION_EXIT 32
+#define CMUX_EVENT_BUFFER_RELEASE 64 /* consumer released space of cmux buffer */
+#define CMUX_EVENT_TX_FLUSH 128 /* frames have waited enough time in tx buffer */
+#define CMUX_EVENT_RX_INDICATE 256 /* data below rx threshold has waited enough time for rx_indicate */
+#define CMUX_EVENT_ERM_T1 512 /* T1 of error recovery mode has expired */
+
+/* the reasons why a frame can't be pushed into frame list */
+#define CMUX_RX_OK 0
+#define CMUX_RX_LIST_FULL 1 /* the frame list is longer than CMUX_MAX_FRAME_LIST_LEN */
+#define CMUX_RX_VCOM_BUDGET 2 /* the byte budget of channel is used up */
+#define CMUX_RX_OBJECT_BUDGET 3 /* the byte budget of cmux object is used up */
+
+/* the queued bytes to stop the modem sending by flow control, and to resume it */
+#define CMUX_BYTES_HIGH_WATER(budget) ((budget) / 4 * 3)
+#define CMUX_BYTES_LOW_WATER(budget) ((budget) / 4)
+
+/* the flow control messages should be sent after updating the flow state of receiving */
+#define CMUX_RX_FLOW_MSC_OFF 1
+#define CMUX_RX_FLOW_MSC_ON 2
+#define CMUX_RX_FLOW_FCOFF 4
+#define CMUX_RX_FLOW_FCON 8
+
+/* the max length of messages in a control channel frame, longer frames are dropped */
+#define CMUX_CONTROL_MSG_MAX 64
+
+#ifdef CMUX_USING_FRAME_POOL
+#define cmux_mem_free(ptr) rt_mp_free(ptr)
+#else
+#define cmux_mem_free(ptr) rt_free(ptr)
+#endif
 
 #define DBG_TAG "cmux"
 
@@ -77,10 +130,21 @@
 #endif
 #include <rtdbg.h>
 
-static rt_size_t cmux_send_data(struct rt_device *dev, int port, rt_uint8_t type, const char *data, int length);
+static rt_size_t cmux_send_data(struct cmux *cmux, int port, rt_uint8_t type, const char *data, int length);
+static rt_size_t cmux_send_control(struct cmux *cmux, rt_uint8_t type, const rt_uint8_t *value, int length);
+static rt_size_t cmux_send_msc(struct cmux *cmux, int port, rt_bool_t flow_off);
+static void cmux_pn_apply(struct cmux *cmux, int port, rt_uint16_t frame_size);
+static void cmux_dlc_response(struct cmux *cmux, int port, rt_bool_t accepted);
+static void cmux_dlc_remote(struct cmux *cmux, int port, rt_bool_t open);
+static void cmux_send_dm(struct cmux *cmux, int dlci);
+#ifdef CMUX_USING_ERROR_RECOVERY
+static rt_bool_t cmux_erm_process(struct cmux *cmux, struct cmux_frame *frame);
+static void cmux_erm_ack_flush(struct cmux *cmux);
+static rt_bool_t cmux_erm_window_open(struct cmux *cmux, struct cmux_vcoms *vcom);
+static void cmux_erm_rx_ready(struct cmux *cmux, int port);
+static void cmux_erm_clear(struct cmux *cmux, int port);
+#endif
 static rt_slist_t cmux_list = RT_SLIST_OBJECT_INIT(cmux_list);
-/* only one cmux object can be created */
-static struct cmux *_g_cmux = RT_NULL;
 
 /**
  * Get the cmux object that your used device.
@@ -111,7 +175,8 @@ struct cmux *cmux_object_find(const char *name)
 }
 
 /**
- * Receive callback function , send CMUX_EVENT_RX_NOTIFY event when uart acquire data
+ * Receive callback function , send CMUX_EVENT_RX_NOTIFY event when uart acquire data.
+ * idle line, DMA half and full notifications are merged until receive thread reads serial
  *
  * @param dev       the point of device driver structure, uart structure
  * @param size      the indication callback function need this parameter
@@ -122,15 +187,130 @@ static rt_err_t cmux_rx_ind(rt_device_t dev, rt_size_t size)
 {
     RT_ASSERT(dev != RT_NULL);
     struct cmux *cmux = RT_NULL;
+    struct rt_slist_node *node = RT_NULL;
+    rt_bool_t notified = RT_TRUE;
+    rt_base_t level;
 
-    cmux = _g_cmux;
+    /* find the cmux object using this actual serial */
+    level = rt_hw_interrupt_disable();
+    rt_slist_for_each(node, &cmux_list)
+    {
+        cmux = rt_slist_entry(node, struct cmux, list);
+        if (cmux->dev == dev)
+        {
+            cmux->stat.rx_notifies++;
+            notified = cmux->rx_notified;
+            cmux->rx_notified = RT_TRUE;
+            break;
+        }
+    }
+    rt_hw_interrupt_enable(level);
 
     /* when receive data from uart , send event to wake up receive thread */
-    rt_event_send(cmux->event, CMUX_EVENT_RX_NOTIFY);
+    if (!notified)
+    {
+        rt_event_send(cmux->event, CMUX_EVENT_RX_NOTIFY);
+    }
 
     return RT_EOK;
 }
 
+/**
+ *  initialize the wait queue of virtual serial
+ *
+ * @param waitq         the wait queue
+ * @param name          the name of semaphore
+ *
+ * @return  RT_NULL
+ */
+static void cmux_waitq_init(struct cmux_waitq *waitq, const char *name)
+{
+    rt_sem_init(&waitq->sem, name, 0, RT_IPC_FLAG_FIFO);
+    waitq->waiters = 0;
+}
+
+/**
+ *  sleep on the wait queue, it must be called with interrupt disabled after the condition is checked,
+ *  so the waker can't be missed. interrupt is enabled when it returns
+ *
+ * @param waitq         the wait queue
+ * @param level         the interrupt level returned by rt_hw_interrupt_disable
+ * @param timeout       the max ticks to sleep
+ *
+ * @return  RT_EOK          woken up, the condition should be checked again
+ *          -RT_ETIMEOUT    timeout
+ */
+static rt_err_t cmux_waitq_wait(struct cmux_waitq *waitq, rt_base_t level, rt_int32_t timeout)
+{
+    rt_err_t result;
+
+    if (timeout == 0)
+    {
+        rt_hw_interrupt_enable(level);
+        return -RT_ETIMEOUT;
+    }
+    waitq->waiters++;
+    rt_hw_interrupt_enable(level);
+
+    result = rt_sem_take(&waitq->sem, timeout);
+    if (result != RT_EOK)
+    {
+        /* a waker may have counted us already, the extra release only causes a spurious wakeup */
+        level = rt_hw_interrupt_disable();
+        if (waitq->waiters > 0)
+        {
+            waitq->waiters--;
+        }
+        rt_hw_interrupt_enable(level);
+    }
+
+    return result;
+}
+
+/**
+ *  wake up all threads sleeping on the wait queue, they check their condition again
+ *
+ * @param waitq         the wait queue
+ *
+ * @return  RT_NULL
+ */
+static void cmux_waitq_wakeup(struct cmux_waitq *waitq)
+{
+    rt_base_t level;
+    rt_uint16_t waiters;
+
+    level = rt_hw_interrupt_disable();
+    waiters = waitq->waiters;
+    waitq->waiters = 0;
+    rt_hw_interrupt_enable(level);
+
+    while (waiters--)
+    {
+        rt_sem_release(&waitq->sem);
+    }
+}
+
+/**
+ *  the ticks left of a timeout after some time has been spent in waiting
+ *
+ * @param start         the tick when waiting started
+ * @param timeout       the whole timeout
+ *
+ * @return  the ticks left, RT_WAITING_FOREVER is kept
+ */
+static rt_int32_t cmux_wait_left(rt_tick_t start, rt_int32_t timeout)
+{
+    rt_tick_t elapsed;
+
+    if (timeout < 0)
+    {
+        return RT_WAITING_FOREVER;
+    }
+    elapsed = rt_tick_get() - start;
+
+    return elapsed >= (rt_tick_t)timeout ? 0 : timeout - (rt_int32_t)elapsed;
+}
+
 /**
  *  invoke callback function
  *
@@ -145,14 +325,75 @@ void cmux_vcom_isr(struct cmux *cmux, rt_uint8_t port, rt_size_t size)
     /* when receive data, we should notify user immediately. */
     if (cmux->vcoms[port].device.rx_indicate != RT_NULL)
     {
+        cmux->vcoms[port].stat.rx_indicates++;
         cmux->vcoms[port].device.rx_indicate(&cmux->vcoms[port].device, size);
     }
-    else
+    else if (cmux->vcoms[port].rx_timeout == 0)
     {
+        /* the blocking readers don't need rx_indicate */
         LOG_W("channel[%02d] haven appended data, please set rx_indicate and clear receive data.", port);
     }
 }
 
+#ifdef CMUX_USING_RX_COALESCE
+/**
+ *  invoke rx_indicate once for every channel which has got data in this batch, the size is all the bytes queued
+ *  for the channel. data below the rx threshold of channel waits at most rx_notify_time
+ *
+ * @param cmux          cmux object
+ * @param force         notify all channels having data, rx_notify_time is up
+ *
+ * @return  RT_NULL
+ */
+static void cmux_rx_notify(struct cmux *cmux, rt_bool_t force)
+{
+    struct cmux_vcoms *vcom = RT_NULL;
+    rt_bool_t waiting = RT_FALSE;
+    int i;
+
+    for (i = 1; i < cmux->vcom_num; i++)
+    {
+        vcom = &cmux->vcoms[i];
+        if (vcom->rx_pending == 0)
+        {
+            continue;
+        }
+        if (force || cmux->rx_notify_time == 0 || vcom->rx_pending >= vcom->rx_threshold)
+        {
+            vcom->rx_pending = 0;
+            cmux_vcom_isr(cmux, (rt_uint8_t)i, vcom->rx_queued);
+        }
+        else
+        {
+            waiting = RT_TRUE;
+        }
+    }
+
+    if (force)
+    {
+        cmux->rx_timer_active = RT_FALSE;
+    }
+    else if (waiting && !cmux->rx_timer_active)
+    {
+        cmux->rx_timer_active = RT_TRUE;
+        rt_timer_control(cmux->rx_timer, RT_TIMER_CTRL_SET_TIME, &cmux->rx_notify_time);
+        rt_timer_start(cmux->rx_timer);
+    }
+}
+
+/**
+ *  timeout function of rx timer, let receive thread notify the channels waiting for rx threshold
+ *
+ * @param parameter     cmux object
+ */
+static void cmux_rx_timeout(void *parameter)
+{
+    struct cmux *cmux = (struct cmux *)parameter;
+
+    rt_event_send(cmux->event, CMUX_EVENT_RX_INDICATE);
+}
+#endif
+
 /**
  *  allocate buffer for cmux object receive
  *
@@ -169,415 +410,3300 @@ static struct cmux_buffer *cmux_buffer_init()
         return RT_NULL;
     }
     rt_memset(buff, 0, sizeof(struct cmux_buffer));
-    buff->read_point = buff->data;
+#ifdef CMUX_USING_RX_ZERO_COPY
     buff->write_point = buff->data;
     buff->end_point = buff->data + CMUX_BUFFER_SIZE;
+    buff->hold_point = buff->data;
+#endif
     return buff;
 }
 
+#ifdef CMUX_USING_FRAME_POOL
 /**
- *  destroy buffer for cmux object receive
+ *  allocate memory pools for cmux object receive, the pools are sized by the number of port and CMUX_MAX_FRAME_LIST_LEN
  *
- * @param frame         the point of cmux_frame
+ * @param vcom_num      the number of virtual serial
  *
- * @return  RT_NULL
+ * @return  the point of struct cmux_pool
  */
-static void cmux_frame_destroy(struct cmux_frame *frame)
+static struct cmux_pool *cmux_pool_init(rt_uint8_t vcom_num)
 {
-    if ((frame->data_length > 0) && frame->data)
+    struct cmux_pool *pool = RT_NULL;
+    /* each port queues CMUX_MAX_FRAME_LIST_LEN + 1 frames and reads one, receive thread parses one */
+    rt_size_t frame_num = vcom_num * (CMUX_MAX_FRAME_LIST_LEN + 2) + 1;
+    const rt_size_t data_num[CMUX_POOL_CLASS_NUM] = {CMUX_POOL_SMALL_NUM, CMUX_POOL_MEDIUM_NUM, CMUX_POOL_LARGE_NUM};
+    int i;
+
+    pool = rt_malloc(sizeof(struct cmux_pool));
+    if (pool == RT_NULL)
     {
-        rt_free(frame->data);
+        return RT_NULL;
     }
-    if (frame)
+    rt_memset(pool, 0, sizeof(struct cmux_pool));
+
+    pool->frame_mp = rt_mp_create("cmux_f", frame_num, sizeof(struct cmux_frame));
+    if (pool->frame_mp == RT_NULL)
+    {
+        goto __exit;
+    }
+#ifndef CMUX_USING_RX_ZERO_COPY
+    /* frame data stays in cmux buffer in zero copy mode, data pools are unnecessary */
+    {
+        const rt_size_t data_size[CMUX_POOL_CLASS_NUM] = {CMUX_POOL_SMALL_SIZE, CMUX_POOL_MEDIUM_SIZE, CMUX_FRAME_SIZE_MAX};
+
+        for (i = 0; i < CMUX_POOL_CLASS_NUM; i++)
+        {
+            pool->data_mp[i] = rt_mp_create("cmux_d", vcom_num * data_num[i], data_size[i]);
+            if (pool->data_mp[i] == RT_NULL)
+            {
+                goto __exit;
+            }
+        }
+    }
+#endif
+    LOG_D("cmux pool init, frame: %d, data: %d/%d/%d.", (int)frame_num,
+            (int)(vcom_num * data_num[0]), (int)(vcom_num * data_num[1]), (int)(vcom_num * data_num[2]));
+
+    return pool;
+
+__exit:
+    if (pool->frame_mp)
+        rt_mp_delete(pool->frame_mp);
+    for (i = 0; i < CMUX_POOL_CLASS_NUM; i++)
     {
-        rt_free(frame);
+        if (pool->data_mp[i])
+            rt_mp_delete(pool->data_mp[i]);
     }
+    rt_free(pool);
+    return RT_NULL;
 }
+#endif
 
 /**
- *  initial virtual serial for different channel, initial slist for channel
+ *  allocate struct cmux_frame on the receive path
  *
  * @param cmux          cmux object
- * @param channel       the number of virtual serial
  *
- * @return  RT_NULL
+ * @return  the point of struct cmux_frame or RT_NULL
  */
-static void vcoms_cmux_frame_init(struct cmux *cmux, int channel)
+static struct cmux_frame *cmux_frame_alloc(struct cmux *cmux)
 {
-    rt_base_t level;
-
-    level = rt_hw_interrupt_disable();
-    rt_slist_init(&cmux->vcoms[channel].flist);
-    rt_hw_interrupt_enable(level);
-    cmux->vcoms[channel].frame_index = 0;
-
-    LOG_D("init cmux data channel(%d) list.", channel);
+    cmux->stat.rx_allocs++;
+#ifdef CMUX_USING_FRAME_POOL
+    return (struct cmux_frame *)rt_mp_alloc(cmux->pool->frame_mp, RT_WAITING_NO);
+#else
+    return (struct cmux_frame *)rt_malloc(sizeof(struct cmux_frame));
+#endif
 }
 
+#ifndef CMUX_USING_RX_ZERO_COPY
 /**
- *  push cmux frame data into slist for different channel virtual serial
+ *  allocate space for frame data, the smallest free block which can hold the data is used in pool mode
  *
  * @param cmux          cmux object
- * @param channel       the number of virtual serial
- * @param frame         the point of frame data
+ * @param size          the length of frame data
  *
- * @return  RT_EOK      successful
- *          RT_ENOMEM   allocate memory failed
+ * @return  the point of frame data or RT_NULL
  */
-static rt_err_t cmux_frame_push(struct cmux *cmux, int channel, struct cmux_frame *frame)
+static rt_uint8_t *cmux_data_alloc(struct cmux *cmux, rt_size_t size)
 {
-    rt_base_t level;
-    struct frame *frame_new = RT_NULL;
-    rt_uint16_t frame_len = cmux->vcoms[channel].frame_index;
+#ifdef CMUX_USING_FRAME_POOL
+    rt_uint8_t *data = RT_NULL;
+    int i;
 
-    if (frame_len <= CMUX_MAX_FRAME_LIST_LEN)
+    cmux->stat.rx_allocs++;
+    for (i = 0; i < CMUX_POOL_CLASS_NUM && data == RT_NULL; i++)
     {
-        frame_new = rt_malloc(sizeof(struct frame));
-        if (frame_new == RT_NULL)
+        if (size <= cmux->pool->data_mp[i]->block_size)
         {
-            LOG_E("can't malloc <struct frame> to record data address.");
-            return -RT_ENOMEM;
-        }
-        else
-        {
-            rt_memset(frame_new, 0, sizeof(struct frame));
-
-            frame_new->frame = frame;
-            rt_slist_init(&frame_new->frame_list);
+            data = (rt_uint8_t *)rt_mp_alloc(cmux->pool->data_mp[i], RT_WAITING_NO);
         }
+    }
+    return data;
+#else
+    cmux->stat.rx_allocs++;
+    return (rt_uint8_t *)rt_malloc(size);
+#endif
+}
+#endif
 
-        level = rt_hw_interrupt_disable();
-        rt_slist_append(&cmux->vcoms[channel].flist, &frame_new->frame_list);
-        rt_hw_interrupt_enable(level);
+#ifdef CMUX_USING_RX_ZERO_COPY
+/**
+ *  move hold point of cmux buffer to the oldest frame which haven't been released, must be called with interrupt disabled
+ *
+ * @param buff          the buffer of cmux object
+ *
+ * @return  RT_NULL
+ */
+static void cmux_buffer_hold_update(struct cmux_buffer *buff)
+{
+    if (buff->hold_head != RT_NULL)
+    {
+        buff->hold_point = buff->hold_head->data;
+    }
+    else
+    {
+        buff->hold_point = buff->write_point;
+    }
+}
 
-#ifdef CMUX_DEBUG
-        LOG_HEX("CMUX_RX", 32, frame->data, frame->data_length);
-#endif
+/**
+ *  record frame which references data of cmux buffer, the frame region will be hold until it is released
+ *
+ * @param buff          the buffer of cmux object
+ * @param frame         the point of cmux_frame
+ *
+ * @return  RT_NULL
+ */
+static void cmux_buffer_hold(struct cmux_buffer *buff, struct cmux_frame *frame)
+{
+    rt_base_t level;
 
-        LOG_D("new message (len:%d) for channel (%d) is append, Message total: %d.", frame_new->frame->data_length, channel, ++cmux->vcoms[channel].frame_index);
+    frame->released = RT_FALSE;
+    frame->hold_next = RT_NULL;
 
-        return RT_EOK;
+    level = rt_hw_interrupt_disable();
+    if (buff->hold_tail != RT_NULL)
+    {
+        buff->hold_tail->hold_next = frame;
     }
-    LOG_E("malloc failed, the message for channel(%d) is long than CMUX_MAX_FRAME_LIST_LEN(%d).", channel, CMUX_MAX_FRAME_LIST_LEN);
-    return -RT_ENOMEM;
+    else
+    {
+        buff->hold_head = frame;
+    }
+    buff->hold_tail = frame;
+    cmux_buffer_hold_update(buff);
+    rt_hw_interrupt_enable(level);
 }
+#endif
 
 /**
- *  pop cmux frame data from slist for different channel virtual serial
+ *  destroy buffer for cmux object receive
  *
  * @param cmux          cmux object
- * @param channel       the number of virtual serial
+ * @param frame         the point of cmux_frame
  *
- * @return  frame_data  successful
- *          RT_NULL     no message on the slist
+ * @return  RT_NULL
  */
-static struct cmux_frame *cmux_frame_pop(struct cmux *cmux, int channel)
+static void cmux_frame_destroy(struct cmux *cmux, struct cmux_frame *frame)
 {
+#ifdef CMUX_USING_RX_ZERO_COPY
+    struct cmux_buffer *buff = cmux->buffer;
+    struct cmux_frame *head = RT_NULL, *released = RT_NULL;
+    rt_bool_t stalled = RT_FALSE;
     rt_base_t level;
-    struct frame *frame = RT_NULL;
-    struct cmux_frame *frame_data = RT_NULL;
-    struct rt_slist_node *frame_list_find = RT_NULL;
-    rt_slist_t *frame_list = RT_NULL;
 
-    frame_list = &cmux->vcoms[channel].flist;
-
-    frame_list_find = rt_slist_first(frame_list);
-    if (frame_list_find != RT_NULL)
+    /* frames without data don't hold cmux buffer, the frames of advanced option hold it even if they are empty */
+    if (frame->data == RT_NULL)
     {
-        frame = rt_container_of(frame_list_find, struct frame, frame_list);
-        frame_data = frame->frame;
-
-        level = rt_hw_interrupt_disable();
-        rt_slist_remove(frame_list, frame_list_find);
-        rt_hw_interrupt_enable(level);
+        cmux_mem_free(frame);
+        return;
+    }
 
-        LOG_D("A message (len:%d) for channel (%d) has been used, Message remain: %d.", frame_data->data_length, channel, --cmux->vcoms[channel].frame_index);
-        rt_free(frame);
+    /* the buffer is released in order, frames behind the oldest frame only get marked */
+    level = rt_hw_interrupt_disable();
+    frame->released = RT_TRUE;
+    while (buff->hold_head != RT_NULL && buff->hold_head->released)
+    {
+        head = buff->hold_head;
+        buff->hold_head = head->hold_next;
+        head->hold_next = released;
+        released = head;
+    }
+    if (buff->hold_head == RT_NULL)
+    {
+        buff->hold_tail = RT_NULL;
+    }
+    cmux_buffer_hold_update(buff);
+    if (released != RT_NULL && buff->stalled)
+    {
+        buff->stalled = RT_FALSE;
+        stalled = RT_TRUE;
     }
+    rt_hw_interrupt_enable(level);
 
-    return frame_data;
+    while (released != RT_NULL)
+    {
+        head = released;
+        released = head->hold_next;
+        cmux_mem_free(head);
+    }
+    /* wake up receive thread, it is waiting for buffer space */
+    if (stalled)
+    {
+        rt_event_send(cmux->event, CMUX_EVENT_BUFFER_RELEASE);
+    }
+#else
+    if ((frame->data_length > 0) && frame->data)
+    {
+        cmux_mem_free(frame->data);
+    }
+    if (frame)
+    {
+        cmux_mem_free(frame);
+    }
+#endif
 }
 
 /**
- *  write data into cmux buffer
- *
- * @param buff        the buffer of cmux object
- * @param input       the point of data
- * @param count       the length of data
+ *  copy frame data to user buffer
  *
- * @return length     the length of write into cmux buffer
+ * @param cmux          cmux object
+ * @param frame         the point of cmux_frame
+ * @param offset        the offset of frame data
+ * @param buffer        the buffer of user
+ * @param size          the length of copy
  *
+ * @return  RT_NULL
  */
-rt_size_t cmux_buffer_write(struct cmux_buffer *buff, rt_uint8_t *input, rt_size_t count)
+static void cmux_frame_read_data(struct cmux *cmux, struct cmux_frame *frame, rt_size_t offset, void *buffer, rt_size_t size)
 {
-    int c = buff->end_point - buff->write_point;
+#ifdef CMUX_USING_RX_ZERO_COPY
+    struct cmux_buffer *buff = cmux->buffer;
+    rt_uint8_t *data = frame->data + offset;
+    rt_size_t end;
 
-    count = min(count, cmux_buffer_free(buff));
-    if (count > c)
+    if (data >= buff->end_point)
+    {
+        data -= CMUX_BUFFER_SIZE;
+    }
+    /* frame data wraps around the end of cmux buffer */
+    end = buff->end_point - data;
+    if (size > end)
     {
-        rt_memcpy(buff->write_point, input, c);
-        rt_memcpy(buff->data, input + c, count - c);
-        buff->write_point = buff->data + (count - c);
+        rt_memcpy(buffer, data, end);
+        rt_memcpy((rt_uint8_t *)buffer + end, buff->data, size - end);
     }
     else
     {
-        rt_memcpy(buff->write_point, input, count);
-        buff->write_point += count;
-        if (buff->write_point == buff->end_point)
-            buff->write_point = buff->data;
+        rt_memcpy(buffer, data, size);
     }
-
-    return count;
+#else
+    rt_memcpy(buffer, frame->data + offset, size);
+#endif
 }
 
 /**
- *  parse buffer for searching cmux frame
+ *  update the flow state of receiving after frames are queued or drained, must be called with interrupt disabled
  *
- * @param buffer        the cmux buffer for cmux object
+ * @param cmux          cmux object
+ * @param vcom          the virtual serial
  *
- * @return  frame       successful
- *          RT_NULL     no frame in the buffer
+ * @return  the flow control messages should be sent, CMUX_RX_FLOW_xxx
  */
-static struct cmux_frame *cmux_frame_parse(struct cmux_buffer *buffer)
+static int cmux_rx_flow_update(struct cmux *cmux, struct cmux_vcoms *vcom)
 {
-    int end;
-    int length_needed = 5; /* channel, type, length, fcs, flag */
-    rt_uint8_t *data = RT_NULL;
-    rt_uint8_t fcs = 0xFF;
-    struct cmux_frame *frame = RT_NULL;
+    int flow = 0;
 
-    extern rt_uint8_t cmux_crctable[256];
-
-    /* Find start flag */
-    while (!buffer->flag_found && cmux_buffer_length(buffer) > 0)
+    /* the frame list is nearly full, ask the modem to stop sending on this channel */
+    if (vcom->rx_policy == CMUX_RX_POLICY_FLOW_CONTROL && !vcom->rx_flow_off &&
+            (vcom->frame_index >= CMUX_FLOW_HIGH_WATER || vcom->rx_queued >= CMUX_BYTES_HIGH_WATER(vcom->rx_bytes_max)))
     {
-        if (*buffer->read_point == CMUX_HEAD_FLAG)
-            buffer->flag_found = 1;
-        INC_BUF_POINTER(buffer, buffer->read_point);
+        vcom->rx_flow_off = RT_TRUE;
+        vcom->stat.rx_flow_offs++;
+        flow |= CMUX_RX_FLOW_MSC_OFF;
     }
-    if (!buffer->flag_found) /* no frame started */
-        return RT_NULL;
-
-    /* skip empty frames (this causes troubles if we're using DLC 62) */
-    while (cmux_buffer_length(buffer) > 0 && (*buffer->read_point == CMUX_HEAD_FLAG))
+    else if (vcom->rx_flow_off && vcom->frame_index <= CMUX_FLOW_LOW_WATER && vcom->rx_queued <= CMUX_BYTES_LOW_WATER(vcom->rx_bytes_max))
     {
-        INC_BUF_POINTER(buffer, buffer->read_point);
+        vcom->rx_flow_off = RT_FALSE;
+        flow |= CMUX_RX_FLOW_MSC_ON;
     }
 
-    if (cmux_buffer_length(buffer) >= length_needed)
+    /* frames of all channels nearly use up the budget of object, ask the modem to stop all channels */
+    if (!cmux->rx_flow_off && cmux->rx_queued >= CMUX_BYTES_HIGH_WATER(cmux->rx_bytes_max))
     {
-        data = buffer->read_point;
-        frame = (struct cmux_frame *)rt_malloc(sizeof(struct cmux_frame));
-        frame->data = RT_NULL;
-
-        frame->channel = ((*data & 0xFC) >> 2);
-        fcs = cmux_crctable[fcs ^ *data];
-        INC_BUF_POINTER(buffer, data);
+        cmux->rx_flow_off = RT_TRUE;
+        cmux->stat.rx_flow_offs++;
+        flow |= CMUX_RX_FLOW_FCOFF;
+    }
+    else if (cmux->rx_flow_off && cmux->rx_queued <= CMUX_BYTES_LOW_WATER(cmux->rx_bytes_max))
+    {
+        cmux->rx_flow_off = RT_FALSE;
+        flow |= CMUX_RX_FLOW_FCON;
+    }
 
-        frame->control = *data;
-        fcs = cmux_crctable[fcs ^ *data];
-        INC_BUF_POINTER(buffer, data);
+    return flow;
+}
 
-        frame->data_length = (*data & 254) >> 1;
-        fcs = cmux_crctable[fcs ^ *data];
-        /* frame data length more than 127 bytes */
-        if ((*data & 1) == 0)
-        {
-            INC_BUF_POINTER(buffer,data);
-            frame->data_length += (*data*128);
-            fcs = cmux_crctable[fcs^*data];
-            length_needed++;
-            LOG_D("len_need: %d, frame_data_len: %d.", length_needed, frame->data_length);
-        }
-        length_needed += frame->data_length;
-        if (cmux_buffer_length(buffer) < length_needed)
-        {
-            cmux_frame_destroy(frame);
-            return RT_NULL;
-        }
-        INC_BUF_POINTER(buffer, data);
-        /* extract data */
-        if (frame->data_length > 0)
-        {
-            frame->data = (unsigned char *)rt_malloc(frame->data_length);
-            if (frame->data != RT_NULL)
-            {
-                end = buffer->end_point - data;
-                if (frame->data_length > end)
-                {
-                    rt_memcpy(frame->data, data, end);
-                    rt_memcpy(frame->data + end, buffer->data, frame->data_length - end);
-                    data = buffer->data + (frame->data_length - end);
-                }
-                else
+/**
+ *  send the flow control messages decided by cmux_rx_flow_update
+ *
+ * @param cmux          cmux object
+ * @param channel       the number of virtual serial
+ * @param flow          CMUX_RX_FLOW_xxx
+ *
+ * @return  RT_NULL
+ */
+static void cmux_rx_flow_send(struct cmux *cmux, int channel, int flow)
+{
+    if (flow & CMUX_RX_FLOW_MSC_OFF)
+    {
+        LOG_D("the frame list of channel(%d) is nearly full, send MSC with FC bit.", channel);
+        cmux_send_msc(cmux, channel, RT_TRUE);
+    }
+    if (flow & CMUX_RX_FLOW_MSC_ON)
+    {
+        LOG_D("the frame list of channel(%d) is drained, send MSC without FC bit.", channel);
+        cmux_send_msc(cmux, channel, RT_FALSE);
+    }
+    if (flow & CMUX_RX_FLOW_FCOFF)
+    {
+        LOG_D("the frames of cmux object nearly use up %d bytes, send FCoff.", (int)cmux->rx_bytes_max);
+        cmux_send_control(cmux, CMUX_C_FCOFF | CMUX_ADDRESS_CR, RT_NULL, 0);
+    }
+    if (flow & CMUX_RX_FLOW_FCON)
+    {
+        LOG_D("the frames of cmux object are drained, send FCon.");
+        cmux_send_control(cmux, CMUX_C_FCON | CMUX_ADDRESS_CR, RT_NULL, 0);
+    }
+}
+
+/**
+ *  tell why the frame can't be pushed into the frame list of channel, must be called with interrupt disabled
+ *
+ * @param cmux          cmux object
+ * @param vcom          the virtual serial
+ * @param length        the data length of the frame
+ *
+ * @return  CMUX_RX_OK or the reason of overflow
+ */
+static int cmux_frame_overflow(struct cmux *cmux, struct cmux_vcoms *vcom, rt_size_t length)
+{
+    if (vcom->frame_index > CMUX_MAX_FRAME_LIST_LEN)
+    {
+        return CMUX_RX_LIST_FULL;
+    }
+    if (vcom->rx_queued + length > vcom->rx_bytes_max)
+    {
+        return CMUX_RX_VCOM_BUDGET;
+    }
+    if (cmux->rx_queued + length > cmux->rx_bytes_max)
+    {
+        return CMUX_RX_OBJECT_BUDGET;
+    }
+    return CMUX_RX_OK;
+}
+
+/**
+ *  append frame data into the byte fifo of virtual serial, must be called with fifo_lock taken
+ *
+ * @param cmux          cmux object
+ * @param fifo          the byte fifo of virtual serial
+ * @param frame         the point of cmux_frame
+ *
+ * @return  the length of data appended
+ */
+static rt_size_t cmux_fifo_put(struct cmux *cmux, struct rt_ringbuffer *fifo, struct cmux_frame *frame)
+{
+#ifdef CMUX_USING_RX_ZERO_COPY
+    rt_size_t first, len;
+#endif
+
+    if (frame->data_length <= 0 || frame->data == RT_NULL)
+    {
+        return 0;
+    }
+#ifdef CMUX_USING_RX_ZERO_COPY
+    /* frame data wraps around the end of cmux buffer */
+    first = min(frame->data_length, cmux->buffer->end_point - frame->data);
+    len = rt_ringbuffer_put(fifo, frame->data, first);
+    if (len < first)
+    {
+        return len;
+    }
+    return len + rt_ringbuffer_put(fifo, cmux->buffer->data, frame->data_length - first);
+#else
+    return rt_ringbuffer_put(fifo, frame->data, frame->data_length);
+#endif
+}
+
+/**
+ *  drop the oldest data of the byte fifo, must be called with fifo_lock taken
+ *
+ * @param fifo          the byte fifo of virtual serial
+ * @param length        the length of data to drop
+ *
+ * @return  the length of data dropped
+ */
+static rt_size_t cmux_fifo_discard(struct rt_ringbuffer *fifo, rt_size_t length)
+{
+    rt_uint8_t trash[32];
+    rt_size_t len, dropped = 0;
+
+    while (length > 0)
+    {
+        len = rt_ringbuffer_get(fifo, trash, min(length, sizeof(trash)));
+        if (len == 0)
+        {
+            break;
+        }
+        length -= len;
+        dropped += len;
+    }
+    return dropped;
+}
+
+/**
+ *  append frame data into the byte fifo of virtual serial, the oldest data is dropped to make room if rx_policy
+ *  allows. must be called with fifo_lock taken, the fifo is copied with interrupt enabled
+ *
+ * @param cmux          cmux object
+ * @param vcom          the virtual serial
+ * @param frame         the point of cmux_frame
+ * @param reason        CMUX_RX_OK or the limit the data is over
+ *
+ * @return  the length of data appended
+ */
+static rt_size_t cmux_fifo_push(struct cmux *cmux, struct cmux_vcoms *vcom, struct cmux_frame *frame, int *reason)
+{
+    rt_base_t level;
+    rt_size_t length = frame->data_length, over = 0;
+
+    level = rt_hw_interrupt_disable();
+    *reason = cmux_frame_overflow(cmux, vcom, length);
+    if (*reason != CMUX_RX_OK && vcom->rx_policy == CMUX_RX_POLICY_DROP_OLDEST)
+    {
+        if (vcom->rx_queued + length > vcom->rx_bytes_max)
+        {
+            over = vcom->rx_queued + length - vcom->rx_bytes_max;
+        }
+        if (cmux->rx_queued + length > cmux->rx_bytes_max)
+        {
+            over = max(over, cmux->rx_queued + length - cmux->rx_bytes_max);
+        }
+        over = min(over, vcom->rx_queued);
+    }
+    rt_hw_interrupt_enable(level);
+
+    if (over > 0)
+    {
+        /* make room by dropping the oldest data of fifo */
+        over = cmux_fifo_discard(vcom->fifo, over);
+
+        level = rt_hw_interrupt_disable();
+        vcom->rx_queued -= over;
+        cmux->rx_queued -= over;
+        vcom->stat.rx_evicted++;
+        *reason = cmux_frame_overflow(cmux, vcom, length);
+        rt_hw_interrupt_enable(level);
+    }
+
+    if (*reason != CMUX_RX_OK)
+    {
+        return 0;
+    }
+    return cmux_fifo_put(cmux, vcom->fifo, frame);
+}
+
+/**
+ *  push cmux frame data into the tail of frame list for different channel virtual serial, frame data is appended
+ *  into the byte fifo instead when the virtual serial has one.
+ *  the frame list is limited by CMUX_MAX_FRAME_LIST_LEN, the byte budget of channel and the byte budget of object,
+ *  rx_policy of the channel decides what to do near and over the limits
+ *
+ * @param cmux          cmux object
+ * @param channel       the number of virtual serial
+ * @param frame         the point of frame data, it is released at once in fifo mode
+ *
+ * @return  RT_EOK      successful
+ *          RT_ENOMEM   the frame list is full
+ */
+static rt_err_t cmux_frame_push(struct cmux *cmux, int channel, struct cmux_frame *frame)
+{
+    rt_base_t level;
+    rt_list_t evicted;
+    struct cmux_frame *oldest = RT_NULL;
+    rt_size_t length = frame->data_length;
+    int reason = CMUX_RX_OK, flow = 0;
+    struct cmux_vcoms *vcom = &cmux->vcoms[channel];
+
+    rt_list_init(&evicted);
+
+    if (vcom->fifo != RT_NULL)
+    {
+        /* only the bytes the fifo takes are queued, the receive thread is the only one adding bytes */
+        rt_mutex_take(vcom->fifo_lock, RT_WAITING_FOREVER);
+        length = cmux_fifo_push(cmux, vcom, frame, &reason);
+    }
+
+    level = rt_hw_interrupt_disable();
+    if (vcom->fifo == RT_NULL)
+    {
+        reason = cmux_frame_overflow(cmux, vcom, length);
+    }
+    /* make room by dropping the oldest frames of this channel, they are destroyed after enabling interrupt */
+    while (reason != CMUX_RX_OK && vcom->rx_policy == CMUX_RX_POLICY_DROP_OLDEST && !rt_list_isempty(&vcom->flist))
+    {
+        oldest = rt_list_entry(vcom->flist.next, struct cmux_frame, list);
+        rt_list_remove(&oldest->list);
+        vcom->frame_index--;
+        vcom->rx_queued -= oldest->data_length;
+        cmux->rx_queued -= oldest->data_length;
+        vcom->stat.rx_evicted++;
+        rt_list_insert_before(&evicted, &oldest->list);
+        reason = cmux_frame_overflow(cmux, vcom, length);
+    }
+
+    if (reason == CMUX_RX_OK)
+    {
+        if (vcom->fifo == RT_NULL)
+        {
+            rt_list_insert_before(&vcom->flist, &frame->list);
+            vcom->frame_index++;
+        }
+        vcom->rx_queued += length;
+        cmux->rx_queued += length;
+        vcom->stat.rx_frames++;
+        vcom->stat.rx_bytes += length;
+        if (vcom->frame_index > vcom->stat.queue_high)
+        {
+            vcom->stat.queue_high = vcom->frame_index;
+        }
+        if (vcom->rx_queued > vcom->stat.queue_bytes_high)
+        {
+            vcom->stat.queue_bytes_high = vcom->rx_queued;
+        }
+        flow = cmux_rx_flow_update(cmux, vcom);
+    }
+    else if (reason == CMUX_RX_LIST_FULL)
+    {
+        vcom->stat.rx_dropped++;
+    }
+    else if (reason == CMUX_RX_VCOM_BUDGET)
+    {
+        vcom->stat.rx_budget_drops++;
+    }
+    else
+    {
+        vcom->stat.rx_object_drops++;
+    }
+    rt_hw_interrupt_enable(level);
+
+    if (vcom->fifo != RT_NULL)
+    {
+        rt_mutex_release(vcom->fifo_lock);
+    }
+
+    while (!rt_list_isempty(&evicted))
+    {
+        oldest = rt_list_entry(evicted.next, struct cmux_frame, list);
+        rt_list_remove(&oldest->list);
+        LOG_D("the oldest message (len:%d) for channel(%d) is dropped.", oldest->data_length, channel);
+        cmux_frame_destroy(cmux, oldest);
+    }
+    cmux_rx_flow_send(cmux, channel, flow);
+
+    if (reason == CMUX_RX_OK)
+    {
+#if defined(CMUX_DEBUG) && !defined(CMUX_USING_RX_ZERO_COPY)
+        LOG_HEX("CMUX_RX", 32, frame->data, length);
+#endif
+        /* the data has been copied into fifo */
+        if (vcom->fifo != RT_NULL)
+        {
+            cmux_frame_destroy(cmux, frame);
+        }
+        cmux_waitq_wakeup(&vcom->rx_wait);
+
+        LOG_D("new message (len:%d) for channel (%d) is append, Message total: %d.", (int)length, channel, vcom->frame_index);
+
+        return RT_EOK;
+    }
+
+    if (reason == CMUX_RX_LIST_FULL)
+    {
+        LOG_E("the message for channel(%d) is dropped, the frame list is long than CMUX_MAX_FRAME_LIST_LEN(%d).", channel, CMUX_MAX_FRAME_LIST_LEN);
+    }
+    else
+    {
+        LOG_E("the message (len:%d) for channel(%d) is dropped, the %s budget(%d bytes) is used up.", (int)length, channel,
+                reason == CMUX_RX_VCOM_BUDGET ? "channel" : "object",
+                reason == CMUX_RX_VCOM_BUDGET ? (int)vcom->rx_bytes_max : (int)cmux->rx_bytes_max);
+    }
+    return -RT_ENOMEM;
+}
+
+/**
+ *  pop cmux frame data from the head of frame list for different channel virtual serial
+ *
+ * @param cmux          cmux object
+ * @param channel       the number of virtual serial
+ *
+ * @return  frame_data  successful
+ *          RT_NULL     no message on the frame list
+ */
+static struct cmux_frame *cmux_frame_pop(struct cmux *cmux, int channel)
+{
+    rt_base_t level;
+    int flow;
+    struct cmux_frame *frame_data = RT_NULL;
+    struct cmux_vcoms *vcom = &cmux->vcoms[channel];
+
+    level = rt_hw_interrupt_disable();
+    if (!rt_list_isempty(&vcom->flist))
+    {
+        frame_data = rt_list_entry(vcom->flist.next, struct cmux_frame, list);
+        rt_list_remove(&frame_data->list);
+        vcom->frame_index--;
+        vcom->rx_queued -= frame_data->data_length;
+        cmux->rx_queued -= frame_data->data_length;
+    }
+    flow = cmux_rx_flow_update(cmux, vcom);
+    rt_hw_interrupt_enable(level);
+
+    cmux_rx_flow_send(cmux, channel, flow);
+#ifdef CMUX_USING_ERROR_RECOVERY
+    cmux_erm_rx_ready(cmux, channel);
+#endif
+
+    if (frame_data != RT_NULL)
+    {
+        LOG_D("A message (len:%d) for channel (%d) has been used, Message remain: %d.", frame_data->data_length, channel, vcom->frame_index);
+    }
+
+    return frame_data;
+}
+
+/**
+ *  read data from the byte fifo of virtual serial, the data of several frames can be read at once
+ *
+ * @param cmux          cmux object
+ * @param vcom          the virtual serial
+ * @param buffer        the buffer of user
+ * @param size          the length of buffer
+ *
+ * @return  the length has been read
+ */
+static rt_size_t cmux_fifo_read(struct cmux *cmux, struct cmux_vcoms *vcom, void *buffer, rt_size_t size)
+{
+    rt_base_t level;
+    rt_size_t len;
+    int flow;
+
+    rt_mutex_take(vcom->fifo_lock, RT_WAITING_FOREVER);
+    len = rt_ringbuffer_get(vcom->fifo, buffer, min(size, rt_ringbuffer_get_size(vcom->fifo)));
+    level = rt_hw_interrupt_disable();
+    vcom->rx_queued -= len;
+    cmux->rx_queued -= len;
+    flow = cmux_rx_flow_update(cmux, vcom);
+    rt_hw_interrupt_enable(level);
+    rt_mutex_release(vcom->fifo_lock);
+
+    cmux_rx_flow_send(cmux, (int)vcom->link_port, flow);
+#ifdef CMUX_USING_ERROR_RECOVERY
+    cmux_erm_rx_ready(cmux, (int)vcom->link_port);
+#endif
+
+    return len;
+}
+
+/**
+ *  drop the frame being received, the parser hunts for the next flag
+ *
+ * @param cmux          cmux object
+ *
+ * @return  RT_NULL
+ */
+static void cmux_frame_parse_reset(struct cmux *cmux)
+{
+    if (cmux->frame != RT_NULL)
+    {
+        cmux_frame_destroy(cmux, cmux->frame);
+        cmux->frame = RT_NULL;
+    }
+    cmux->buffer->state = CMUX_RECIEVE_RESET;
+}
+
+/**
+ *  parse address, control and length field of the frame being received, prepare the frame for its data
+ *
+ * @param cmux          cmux object
+ * @param payload       the position of the first data byte
+ *
+ * @return  RT_NULL
+ */
+static void cmux_frame_parse_header(struct cmux *cmux, rt_uint8_t *payload)
+{
+    struct cmux_buffer *buffer = cmux->buffer;
+    struct cmux_frame *frame = RT_NULL;
+
+    buffer->fcs = cmux_fcs_update(CMUX_FCS_INIT, buffer->header, buffer->header_length);
+    buffer->data_length = (buffer->header[2] & 254) >> 1;
+    /* frame data length more than 127 bytes */
+    if (buffer->header_length == 4)
+    {
+        buffer->data_length += buffer->header[3] * 128;
+    }
+    buffer->data_offset = 0;
+    buffer->dropped = RT_FALSE;
+    buffer->state = CMUX_RECIEVE_PROCESS;
+
+    if (buffer->data_length > CMUX_FRAME_SIZE_MAX)
+    {
+        LOG_W("Dropping frame: data length(%d) is longer than CMUX_FRAME_SIZE_MAX(%d).", buffer->data_length, CMUX_FRAME_SIZE_MAX);
+        cmux->stat.rx_length_errors++;
+        cmux_frame_parse_reset(cmux);
+        return;
+    }
+
+    frame = cmux_frame_alloc(cmux);
+    if (frame == RT_NULL)
+    {
+        LOG_E("Out of memory, when allocating space for frame.");
+        /* skip frame data, the frame will be dropped after checking */
+        buffer->dropped = RT_TRUE;
+        cmux->stat.alloc_failures++;
+        cmux->stat.rx_overflow_bytes += buffer->data_length;
+        return;
+    }
+    frame->channel = ((buffer->header[0] & 0xFC) >> 2);
+    frame->control = buffer->header[1];
+    frame->cr = (buffer->header[0] & CMUX_ADDRESS_CR) ? 1 : 0;
+    frame->data_length = buffer->data_length;
+    frame->data = RT_NULL;
+
+    if (frame->data_length > 0)
+    {
+#ifdef CMUX_USING_RX_ZERO_COPY
+        /* frame data stays in cmux buffer, hold it from the first byte even if it hasn't been received */
+        frame->data = (payload == buffer->end_point) ? buffer->data : payload;
+        cmux_buffer_hold(buffer, frame);
+#else
+        frame->data = cmux_data_alloc(cmux, frame->data_length);
+        if (frame->data == RT_NULL)
+        {
+            LOG_E("Out of memory, when allocating space for frame data.");
+            frame->data_length = 0;
+            buffer->dropped = RT_TRUE;
+            cmux->stat.alloc_failures++;
+            cmux->stat.rx_overflow_bytes += buffer->data_length;
+        }
+#endif
+    }
+    cmux->frame = frame;
+}
+
+#ifdef CMUX_USING_ADVANCED_OPTION
+/**
+ *  parse address and control field of the frame being received in advanced option, prepare the frame for its data
+ *
+ * @param cmux          cmux object
+ * @param payload       the position of the first data byte
+ *
+ * @return  RT_NULL
+ */
+static void cmux_adv_parse_header(struct cmux *cmux, rt_uint8_t *payload)
+{
+    struct cmux_buffer *buffer = cmux->buffer;
+    struct cmux_frame *frame = RT_NULL;
+
+    buffer->fcs = cmux_fcs_update(CMUX_FCS_INIT, buffer->header, 2);
+    buffer->data_offset = 0;
+    buffer->dropped = RT_FALSE;
+    buffer->state = CMUX_RECIEVE_PROCESS;
+
+    frame = cmux_frame_alloc(cmux);
+    if (frame == RT_NULL)
+    {
+        LOG_E("Out of memory, when allocating space for frame.");
+        /* skip frame data, the frame will be dropped after checking */
+        buffer->dropped = RT_TRUE;
+        cmux->stat.alloc_failures++;
+        return;
+    }
+    frame->channel = ((buffer->header[0] & 0xFC) >> 2);
+    frame->control = buffer->header[1];
+    frame->cr = (buffer->header[0] & CMUX_ADDRESS_CR) ? 1 : 0;
+    frame->data_length = 0;
+    frame->data = RT_NULL;
+#ifdef CMUX_USING_RX_ZERO_COPY
+    /* the length is unknown, hold cmux buffer from the first byte, the data is unescaped in place */
+    buffer->adv_point = (payload == buffer->end_point) ? buffer->data : payload;
+    frame->data = buffer->adv_point;
+    cmux_buffer_hold(buffer, frame);
+#else
+    /* the data is allocated at the first data byte */
+    buffer->adv_size = 0;
+#endif
+    cmux->frame = frame;
+}
+
+#ifndef CMUX_USING_RX_ZERO_COPY
+/**
+ *  make room in the frame being received in advanced option, the length is unknown until the closing flag.
+ *  in pool mode the data moves up through the size classes, the bytes moved are less than the block of the class
+ *  below. otherwise the room is CMUX_FRAME_SIZE_MAX at once, it is shrunk at the closing flag
+ *
+ * @param cmux          cmux object
+ * @param size          the length of frame data to hold
+ *
+ * @return  RT_EOK      successful
+ *          -RT_ENOMEM  no memory for frame data
+ */
+static rt_err_t cmux_adv_reserve(struct cmux *cmux, rt_size_t size)
+{
+    struct cmux_buffer *buffer = cmux->buffer;
+    struct cmux_frame *frame = cmux->frame;
+    rt_uint8_t *data = RT_NULL;
+    rt_size_t room = 0;
+#ifdef CMUX_USING_FRAME_POOL
+    int i;
+#endif
+
+    if (size <= buffer->adv_size)
+    {
+        return RT_EOK;
+    }
+
+    cmux->stat.rx_allocs++;
+#ifdef CMUX_USING_FRAME_POOL
+    for (i = 0; i < CMUX_POOL_CLASS_NUM && data == RT_NULL; i++)
+    {
+        if (size <= cmux->pool->data_mp[i]->block_size)
+        {
+            data = (rt_uint8_t *)rt_mp_alloc(cmux->pool->data_mp[i], RT_WAITING_NO);
+            room = cmux->pool->data_mp[i]->block_size;
+        }
+    }
+#else
+    data = (rt_uint8_t *)rt_malloc(CMUX_FRAME_SIZE_MAX);
+    room = CMUX_FRAME_SIZE_MAX;
+#endif
+    if (data == RT_NULL)
+    {
+        return -RT_ENOMEM;
+    }
+    if (frame->data != RT_NULL)
+    {
+        rt_memcpy(data, frame->data, frame->data_length);
+        cmux_mem_free(frame->data);
+    }
+    frame->data = data;
+    buffer->adv_size = room;
+    return RT_EOK;
+}
+#endif
+
+/**
+ *  append unescaped data to the frame being received in advanced option, the data is moved to its place in
+ *  cmux buffer in zero copy mode, otherwise it is copied into the frame data
+ *
+ * @param cmux          cmux object
+ * @param data          the unescaped data
+ * @param length        the length of data
+ *
+ * @return  RT_EOK      successful
+ *          -RT_EFULL   the frame is longer than CMUX_FRAME_SIZE_MAX, it has been dropped
+ */
+static rt_err_t cmux_adv_store(struct cmux *cmux, const rt_uint8_t *data, rt_size_t length)
+{
+    struct cmux_buffer *buffer = cmux->buffer;
+#ifdef CMUX_USING_RX_ZERO_COPY
+    rt_size_t size;
+#endif
+
+    if (buffer->data_offset + length > CMUX_FRAME_SIZE_MAX)
+    {
+        LOG_W("Dropping frame: data length is longer than CMUX_FRAME_SIZE_MAX(%d).", CMUX_FRAME_SIZE_MAX);
+        cmux->stat.rx_length_errors++;
+        cmux_frame_parse_reset(cmux);
+        return -RT_EFULL;
+    }
+    if (CMUX_FCS_COVERS_DATA(buffer->header[1]))
+    {
+        buffer->fcs = cmux_fcs_update(buffer->fcs, data, length);
+    }
+    buffer->data_offset += length;
+    if (buffer->dropped)
+    {
+        return RT_EOK;
+    }
+#ifdef CMUX_USING_RX_ZERO_COPY
+    /* escapes only shrink the data, it never overtakes the bytes not parsed yet */
+    while (length > 0)
+    {
+        size = min(length, buffer->end_point - buffer->adv_point);
+        if (buffer->adv_point != data)
+        {
+            rt_memmove(buffer->adv_point, data, size);
+        }
+        buffer->adv_point += size;
+        if (buffer->adv_point == buffer->end_point)
+        {
+            buffer->adv_point = buffer->data;
+        }
+        data += size;
+        length -= size;
+    }
+#else
+    if (cmux_adv_reserve(cmux, buffer->data_offset) != RT_EOK)
+    {
+        LOG_E("Out of memory, when allocating space for frame data.");
+        /* skip frame data, the frame will be dropped after checking */
+        buffer->dropped = RT_TRUE;
+        cmux->stat.alloc_failures++;
+        return RT_EOK;
+    }
+    rt_memcpy(cmux->frame->data + buffer->data_offset - length, data, length);
+#endif
+    cmux->frame->data_length = buffer->data_offset;
+    return RT_EOK;
+}
+
+/**
+ *  take unescaped bytes of the frame being received in advanced option, the last byte is kept back because
+ *  it is FCS when the closing flag follows
+ *
+ * @param cmux          cmux object
+ * @param data          the unescaped data
+ * @param length        the length of data, it must be more than 0
+ *
+ * @return  RT_EOK      successful
+ *          -RT_EFULL   the frame is too long, it has been dropped
+ */
+static rt_err_t cmux_adv_commit(struct cmux *cmux, const rt_uint8_t *data, rt_size_t length)
+{
+    struct cmux_buffer *buffer = cmux->buffer;
+
+    if (buffer->pending_valid && cmux_adv_store(cmux, &buffer->pending, 1) != RT_EOK)
+    {
+        return -RT_EFULL;
+    }
+    if (length > 1 && cmux_adv_store(cmux, data, length - 1) != RT_EOK)
+    {
+        return -RT_EFULL;
+    }
+    buffer->pending = data[length - 1];
+    buffer->pending_valid = RT_TRUE;
+    return RT_EOK;
+}
+
+/**
+ *  finish the frame being received in advanced option at the closing flag, the pending byte is FCS
+ *
+ * @param cmux          cmux object
+ *
+ * @return  the frame, RT_NULL when it is dropped
+ */
+static struct cmux_frame *cmux_adv_frame_end(struct cmux *cmux)
+{
+    struct cmux_buffer *buffer = cmux->buffer;
+    struct cmux_frame *frame = cmux->frame;
+
+    if (!buffer->pending_valid || buffer->escaped)
+    {
+        LOG_W("Dropping frame: the frame is aborted or has no FCS.");
+        cmux->stat.rx_flag_errors++;
+        goto __drop;
+    }
+    if (cmux_crctable[buffer->fcs ^ buffer->pending] != CMUX_FCS_GOOD)
+    {
+        LOG_W("Dropping frame: FCS doesn't match.");
+        cmux->stat.rx_fcs_errors++;
+        goto __drop;
+    }
+    if (buffer->dropped)
+    {
+        cmux->stat.rx_overflow_bytes += buffer->data_offset;
+        goto __drop;
+    }
+#if !defined(CMUX_USING_RX_ZERO_COPY) && !defined(CMUX_USING_FRAME_POOL)
+    /* give back the room after the data, the block is shrunk in place */
+    if (frame->data != RT_NULL)
+    {
+        rt_uint8_t *data = (rt_uint8_t *)rt_realloc(frame->data, frame->data_length);
+
+        if (data != RT_NULL)
+        {
+            frame->data = data;
+        }
+    }
+#endif
+    cmux->frame = RT_NULL;
+    cmux->stat.rx_frames++;
+    return frame;
+
+__drop:
+    if (frame != RT_NULL)
+    {
+        cmux_frame_destroy(cmux, frame);
+        cmux->frame = RT_NULL;
+    }
+    return RT_NULL;
+}
+
+/**
+ *  parse the data read from serial in advanced option, the frames are delimited by flags and have no length field,
+ *  the runs without flag and escape octets are found by word scanning and taken at once
+ *
+ * @param cmux          cmux object
+ * @param data          the data read from serial
+ * @param length        the length of data
+ * @param frame         the whole frame found in the data, RT_NULL when no frame is finished
+ *
+ * @return  the length of data has been parsed, the rest of data should be parsed after handling the frame
+ */
+static rt_size_t cmux_frame_parse_advanced(struct cmux *cmux, rt_uint8_t *data, rt_size_t length, struct cmux_frame **frame)
+{
+    struct cmux_buffer *buffer = cmux->buffer;
+    rt_uint8_t *point = data, *end = data + length;
+    rt_uint8_t byte;
+    rt_size_t size;
+
+    *frame = RT_NULL;
+
+    while (point < end)
+    {
+        if (buffer->state != CMUX_RECIEVE_BEGIN && !buffer->escaped)
+        {
+            size = cmux_adv_scan(point, end - point);
+            if (size > 0)
+            {
+                if (buffer->state == CMUX_RECIEVE_PROCESS)
+                {
+                    cmux_adv_commit(cmux, point, size);
+                }
+                point += size;
+                continue;
+            }
+        }
+
+        byte = *point++;
+        if (byte == CMUX_ADV_FLAG)
+        {
+            if (buffer->state == CMUX_RECIEVE_PROCESS)
+            {
+                *frame = cmux_adv_frame_end(cmux);
+            }
+            else if (buffer->state == CMUX_RECIEVE_BEGIN && buffer->header_length > 0)
+            {
+                LOG_W("Dropping frame: the frame is too short.");
+                cmux->stat.rx_flag_errors++;
+            }
+            /* a flag closes the frame and opens the next one, empty frames between flags are skipped */
+            buffer->header_length = 0;
+            buffer->escaped = RT_FALSE;
+            buffer->pending_valid = RT_FALSE;
+            buffer->state = CMUX_RECIEVE_BEGIN;
+            if (*frame != RT_NULL)
+            {
+                return point - data;
+            }
+            continue;
+        }
+        if (buffer->state == CMUX_RECIEVE_RESET)
+        {
+            continue;
+        }
+        if (byte == CMUX_ADV_ESCAPE)
+        {
+            buffer->escaped = RT_TRUE;
+            continue;
+        }
+        if (buffer->escaped)
+        {
+            byte ^= CMUX_ADV_XOR;
+            buffer->escaped = RT_FALSE;
+        }
+
+        if (buffer->state == CMUX_RECIEVE_BEGIN)
+        {
+            buffer->header[buffer->header_length++] = byte;
+            if (buffer->header_length == 2)
+            {
+                cmux_adv_parse_header(cmux, point);
+            }
+            continue;
+        }
+        cmux_adv_commit(cmux, &byte, 1);
+    }
+
+    return point - data;
+}
+#endif
+
+/**
+ *  drop the frame being received after its FCS or end flag is wrong. a corrupted length field makes the frame
+ *  swallow the frames behind it, so its bytes are parsed again from the byte after its start flag.
+ *  the frame is kept until its bytes have been parsed again, they are parsed before the data behind them.
+ *
+ * @param cmux          cmux object
+ * @param point         the byte found wrong, it hasn't been parsed
+ * @param fcs           the FCS octet has been parsed, the end flag is wrong
+ *
+ * @return  RT_NULL
+ */
+static void cmux_frame_rescan(struct cmux *cmux, rt_uint8_t *point, rt_bool_t fcs)
+{
+    struct cmux_buffer *buffer = cmux->buffer;
+
+    /* the frame starts in the bytes being parsed again, they are parsed again from the frame */
+    if (buffer->rescan_frame != RT_NULL)
+    {
+        buffer->rescan_offset = buffer->frame_start;
+        cmux_frame_parse_reset(cmux);
+        return;
+    }
+    /* frame data hasn't been kept */
+    if (cmux->frame == RT_NULL || buffer->dropped)
+    {
+        cmux_frame_parse_reset(cmux);
+        return;
+    }
+
+    rt_memcpy(buffer->rescan_header, buffer->header, buffer->header_length);
+    buffer->rescan_header_length = buffer->header_length;
+    buffer->rescan_length = buffer->data_offset + (fcs ? 1 : 0);
+    buffer->rescan_offset = 0;
+#ifdef CMUX_USING_RX_ZERO_COPY
+    /* frame data and FCS are just in front of the byte found wrong in cmux buffer */
+    buffer->rescan_point = point - buffer->rescan_length;
+    if (buffer->rescan_point < buffer->data)
+    {
+        buffer->rescan_point += CMUX_BUFFER_SIZE;
+    }
+#else
+    buffer->rescan_fcs = buffer->fcs_octet;
+#endif
+    buffer->rescan_frame = cmux->frame;
+    cmux->frame = RT_NULL;
+    buffer->state = CMUX_RECIEVE_RESET;
+}
+
+/**
+ *  get the bytes of the dropped frame from the position being parsed again
+ *
+ * @param cmux          cmux object
+ * @param data          the first byte to parse again
+ *
+ * @return  the length of contiguous bytes, 0 when all bytes have been parsed again
+ */
+static rt_size_t cmux_frame_rescan_data(struct cmux *cmux, rt_uint8_t **data)
+{
+    struct cmux_buffer *buffer = cmux->buffer;
+    int offset = buffer->rescan_offset - buffer->rescan_header_length;
+
+    if (offset < 0)
+    {
+        *data = buffer->rescan_header + buffer->rescan_offset;
+        return -offset;
+    }
+    if (offset >= buffer->rescan_length)
+    {
+        return 0;
+    }
+#ifdef CMUX_USING_RX_ZERO_COPY
+    /* frames found in them reference cmux buffer as usual */
+    *data = buffer->rescan_point + offset;
+    if (*data >= buffer->end_point)
+    {
+        *data -= CMUX_BUFFER_SIZE;
+    }
+    return min(buffer->rescan_length - offset, buffer->end_point - *data);
+#else
+    if (offset < buffer->rescan_frame->data_length)
+    {
+        *data = buffer->rescan_frame->data + offset;
+        return buffer->rescan_frame->data_length - offset;
+    }
+    *data = &buffer->rescan_fcs;
+    return 1;
+#endif
+}
+
+/**
+ *  parse contiguous data for searching cmux frame in basic option, the state of the frame being received is kept
+ *  between calls, so every byte is parsed only once except the bytes of a frame found bad
+ *
+ * @param cmux          cmux object
+ * @param data          the data read from serial, or the bytes of the dropped frame
+ * @param length        the length of data
+ * @param rescan        data is the bytes of the dropped frame, they start at rescan_offset
+ * @param frame         the whole frame found in the data, RT_NULL when no frame is finished
+ *
+ * @return  the length of data has been parsed
+ */
+static rt_size_t cmux_frame_parse_basic(struct cmux *cmux, rt_uint8_t *data, rt_size_t length, rt_bool_t rescan, struct cmux_frame **frame)
+{
+    struct cmux_buffer *buffer = cmux->buffer;
+    rt_uint8_t *point = data, *end = data + length;
+    rt_size_t size;
+
+    while (point < end)
+    {
+        switch (buffer->state)
+        {
+        case CMUX_RECIEVE_RESET:
+            /* Find start flag */
+            if (*point == CMUX_HEAD_FLAG)
+            {
+                buffer->header_length = 0;
+                buffer->state = CMUX_RECIEVE_BEGIN;
+            }
+            point++;
+            break;
+
+        case CMUX_RECIEVE_BEGIN:
+            /* skip empty frames (this causes troubles if we're using DLC 62) */
+            if (buffer->header_length == 0 && *point == CMUX_HEAD_FLAG)
+            {
+                point++;
+                break;
+            }
+            if (buffer->header_length == 0 && rescan)
+            {
+                buffer->frame_start = buffer->rescan_offset + (int)(point - data);
+            }
+            buffer->header[buffer->header_length++] = *point++;
+            /* channel, type, length, and the second byte of length when EA bit isn't set */
+            if (buffer->header_length == 4 || (buffer->header_length == 3 && (buffer->header[2] & 1)))
+            {
+                cmux_frame_parse_header(cmux, point);
+            }
+            break;
+
+        case CMUX_RECIEVE_PROCESS:
+            if (buffer->data_offset < buffer->data_length)
+            {
+                /* extract data, take all bytes of the frame in this data at once */
+                size = min(buffer->data_length - buffer->data_offset, end - point);
+#ifndef CMUX_USING_RX_ZERO_COPY
+                if (!buffer->dropped)
+                {
+                    rt_memcpy(cmux->frame->data + buffer->data_offset, point, size);
+                }
+#endif
+                if (CMUX_FCS_COVERS_DATA(buffer->header[1]))
+                {
+                    buffer->fcs = cmux_fcs_update(buffer->fcs, point, size);
+                }
+                buffer->data_offset += size;
+                point += size;
+                break;
+            }
+            /* check FCS, the byte isn't consumed when it doesn't match, it may be a flag */
+            if (cmux_crctable[buffer->fcs ^ *point] != CMUX_FCS_GOOD)
+            {
+                LOG_W("Dropping frame: FCS doesn't match. Remain size: %d", (int)(end - point));
+                cmux->stat.rx_fcs_errors++;
+                cmux_frame_rescan(cmux, point, RT_FALSE);
+                /* rescan_offset has been moved back when the frame starts in the bytes parsed again */
+                return rescan ? 0 : point - data;
+            }
+#ifndef CMUX_USING_RX_ZERO_COPY
+            buffer->fcs_octet = *point;
+#endif
+            point++;
+            buffer->state = CMUX_RECIEVE_END;
+            break;
+
+        case CMUX_RECIEVE_END:
+            /* check end flag */
+            if (*point != CMUX_HEAD_FLAG)
+            {
+                LOG_W("Dropping frame: End flag not found. Instead: %d.", *point);
+                cmux->stat.rx_flag_errors++;
+                cmux_frame_rescan(cmux, point, RT_TRUE);
+                return rescan ? 0 : point - data;
+            }
+            point++;
+            /* the end flag is taken as the start flag of next frame */
+            buffer->header_length = 0;
+            buffer->state = CMUX_RECIEVE_BEGIN;
+
+            if (buffer->dropped)
+            {
+                if (cmux->frame != RT_NULL)
+                {
+                    cmux_frame_destroy(cmux, cmux->frame);
+                    cmux->frame = RT_NULL;
+                }
+                break;
+            }
+            *frame = cmux->frame;
+            cmux->frame = RT_NULL;
+            cmux->stat.rx_frames++;
+            return point - data;
+        }
+    }
+
+    return point - data;
+}
+
+/**
+ *  parse the data read from serial for searching cmux frame, the state of the frame being received is kept
+ *  between calls, so no data is kept except the frame being received and the frame found bad
+ *
+ * @param cmux          cmux object
+ * @param data          the data read from serial
+ * @param length        the length of data
+ * @param frame         the whole frame found in the data, RT_NULL when no frame is finished
+ *
+ * @return  the length of data has been parsed, the rest of data should be parsed after handling the frame
+ */
+static rt_size_t cmux_frame_parse(struct cmux *cmux, rt_uint8_t *data, rt_size_t length, struct cmux_frame **frame)
+{
+    struct cmux_buffer *buffer = cmux->buffer;
+    rt_uint8_t *rescan = RT_NULL;
+    rt_size_t size, count = 0;
+
+#ifdef CMUX_USING_ADVANCED_OPTION
+    if (cmux->mode == CMUX_MODE_ADVANCED)
+    {
+        return cmux_frame_parse_advanced(cmux, data, length, frame);
+    }
+#endif
+    *frame = RT_NULL;
+
+    while (*frame == RT_NULL && count < length)
+    {
+        /* the bytes of the frame found bad are parsed before the data behind them, the byte found wrong is left */
+        if (buffer->rescan_frame != RT_NULL)
+        {
+            size = cmux_frame_rescan_data(cmux, &rescan);
+            if (size > 0)
+            {
+                buffer->rescan_offset += cmux_frame_parse_basic(cmux, rescan, size, RT_TRUE, frame);
+                continue;
+            }
+            cmux_frame_destroy(cmux, buffer->rescan_frame);
+            buffer->rescan_frame = RT_NULL;
+        }
+        count += cmux_frame_parse_basic(cmux, data + count, length - count, RT_FALSE, frame);
+    }
+
+    return count;
+}
+
+/**
+ *  wake up the writers waiting for flow control, they check the flow state again
+ *
+ * @param cmux          cmux object
+ * @param port          the data channel resumed, 0 means all data channels
+ *
+ * @return  RT_NULL
+ */
+static void cmux_tx_flow_resume(struct cmux *cmux, int port)
+{
+    int i;
+
+    for (i = 1; i < cmux->vcom_num; i++)
+    {
+        if (port == 0 || port == i)
+        {
+            cmux_waitq_wakeup(&cmux->vcoms[i].tx_wait);
+        }
+    }
+}
+
+/**
+ *  wait until the modem allows sending on the virtual serial, control channel is never stopped.
+ *  in error recovery mode, the writer also waits for the room of window and takes it.
+ *  the writer waits for UA while the channel is being established
+ *
+ * @param cmux          cmux object
+ * @param vcom          the virtual serial
+ * @param start         the tick when the write started, tx_timeout covers the whole write
+ *
+ * @return  RT_EOK          the virtual serial can send
+ *          -RT_ETIMEOUT    flow is still off or window is still full after tx_timeout
+ *          -RT_ERROR       the channel isn't established
+ */
+static rt_err_t cmux_tx_flow_wait(struct cmux *cmux, struct cmux_vcoms *vcom, rt_tick_t start)
+{
+    rt_base_t level;
+    rt_err_t result = RT_EOK;
+    rt_bool_t waited = RT_FALSE;
+
+    if (vcom->link_port == 0)
+    {
+        return RT_EOK;
+    }
+
+    while (result == RT_EOK)
+    {
+        level = rt_hw_interrupt_disable();
+        if (vcom->dlc_state != CMUX_DLC_OPEN && vcom->dlc_state != CMUX_DLC_OPENING)
+        {
+            rt_hw_interrupt_enable(level);
+            LOG_D("channel(%d) isn't established, state %d.", vcom->link_port, vcom->dlc_state);
+            result = -RT_ERROR;
+            break;
+        }
+#ifdef CMUX_USING_ERROR_RECOVERY
+        if (vcom->dlc_state == CMUX_DLC_OPEN && !cmux->tx_flow_off && !vcom->tx_flow_off && cmux_erm_window_open(cmux, vcom))
+        {
+            if (cmux->erm_cfg.window > 0)
+            {
+                vcom->erm.reserved++;
+            }
+            rt_hw_interrupt_enable(level);
+            break;
+        }
+#else
+        if (vcom->dlc_state == CMUX_DLC_OPEN && !cmux->tx_flow_off && !vcom->tx_flow_off)
+        {
+            rt_hw_interrupt_enable(level);
+            break;
+        }
+#endif
+        if (!waited)
+        {
+            vcom->stat.tx_flow_waits++;
+            waited = RT_TRUE;
+        }
+        result = cmux_waitq_wait(&vcom->tx_wait, level, cmux_wait_left(start, vcom->tx_timeout));
+    }
+
+    return result;
+}
+
+/**
+ *  handle a message from control channel, commands are answered with the same message as response
+ *
+ * @param cmux          cmux object
+ * @param type          the type of message, including C/R bit
+ * @param value         the value of message
+ * @param length        the length of value
+ *
+ * @return  RT_NULL
+ */
+static void cmux_control_message(struct cmux *cmux, rt_uint8_t type, rt_uint8_t *value, int length)
+{
+    struct cmux_vcoms *vcom = RT_NULL;
+    rt_bool_t flow_off;
+    int port;
+
+    /* the response for our command */
+    if (!(type & CMUX_ADDRESS_CR))
+    {
+        if (CMUX_COMMAND_IS(CMUX_C_NSC, type))
+        {
+            LOG_W("the modem doesn't support command(0x%02x).", length > 0 ? value[0] : 0);
+        }
+        else if (CMUX_COMMAND_IS(CMUX_C_PN, type) && length >= CMUX_PN_LENGTH)
+        {
+            rt_uint16_t frame_size = value[4] | (value[5] << 8);
+
+            /* the modem may answer a smaller N1, but never a larger one than we asked for */
+            port = value[0] & CMUX_DHCL_MASK;
+            if (port > 0 && port < cmux->vcom_num && frame_size > 0 && cmux->vcoms[port].pn_frame_size > 0)
+            {
+                cmux_pn_apply(cmux, port, min(frame_size, cmux->vcoms[port].pn_frame_size));
+            }
+        }
+        else
+        {
+            LOG_D("the response(0x%02x) on control channel.", type);
+        }
+        return;
+    }
+
+    switch (type & ~CMUX_ADDRESS_CR)
+    {
+    case CMUX_C_FCON:
+        LOG_D("the modem can receive frames, flow control on.");
+        cmux->tx_flow_off = RT_FALSE;
+        cmux_tx_flow_resume(cmux, 0);
+        break;
+    case CMUX_C_FCOFF:
+        LOG_D("the modem can't receive frames, flow control off.");
+        if (!cmux->tx_flow_off)
+        {
+            cmux->stat.tx_flow_offs++;
+        }
+        cmux->tx_flow_off = RT_TRUE;
+        break;
+    case CMUX_C_MSC:
+        if (length < 2)
+        {
+            LOG_W("the MSC command is too short(%d).", length);
+            return;
+        }
+        port = value[0] >> 2;
+        flow_off = (value[1] & CMUX_MSC_FC) ? RT_TRUE : RT_FALSE;
+        LOG_D("MSC for channel(%d), signals: 0x%02x.", port, value[1]);
+        if (port > 0 && port < cmux->vcom_num)
+        {
+            vcom = &cmux->vcoms[port];
+            if (flow_off && !vcom->tx_flow_off)
+            {
+                vcom->stat.tx_flow_offs++;
+            }
+            vcom->tx_flow_off = flow_off;
+            if (!flow_off)
+            {
+                cmux_tx_flow_resume(cmux, port);
+            }
+        }
+        break;
+    case CMUX_C_PN:
+        if (length < CMUX_PN_LENGTH)
+        {
+            LOG_W("the PN command is too short(%d).", length);
+            return;
+        }
+        port = value[0] & CMUX_DHCL_MASK;
+        if (port > 0 && port < cmux->vcom_num)
+        {
+            rt_uint16_t frame_size = value[4] | (value[5] << 8);
+
+            /* the N1 answered is the one we can receive, the same values accept the others */
+            frame_size = min(frame_size, CMUX_FRAME_SIZE_MAX);
+            if (frame_size == 0)
+            {
+                frame_size = cmux->frame_size;
+            }
+            value[4] = frame_size & 0xFF;
+            value[5] = frame_size >> 8;
+            cmux_pn_apply(cmux, port, frame_size);
+        }
+        break;
+    case CMUX_C_TEST:
+    case CMUX_C_PSC:
+        break;
+    case CMUX_C_CLD:
+        LOG_W("the modem closes down the multiplexer.");
+        break;
+    default:
+        /* the response of non supported command carries the type of the command */
+        LOG_W("control channel command(0x%02x) haven't support.", type);
+        cmux_send_control(cmux, CMUX_C_NSC, &type, 1);
+        return;
+    }
+
+    cmux_send_control(cmux, type & ~CMUX_ADDRESS_CR, value, length);
+}
+
+/**
+ *  parse the messages in a control channel frame, one frame may carry several messages
+ *
+ * @param cmux          cmux object
+ * @param frame         the frame from control channel
+ *
+ * @return  RT_NULL
+ */
+static void cmux_control_process(struct cmux *cmux, struct cmux_frame *frame)
+{
+    rt_uint8_t msg[CMUX_CONTROL_MSG_MAX];
+    rt_uint8_t type;
+    int offset = 0, length;
+
+    if (frame->data_length > CMUX_CONTROL_MSG_MAX)
+    {
+        LOG_W("Dropping control frame: data length(%d) is longer than %d.", frame->data_length, CMUX_CONTROL_MSG_MAX);
+        return;
+    }
+    cmux_frame_read_data(cmux, frame, 0, msg, frame->data_length);
+
+    /* type, length 1-2, value */
+    while (offset + 2 <= frame->data_length)
+    {
+        type = msg[offset++];
+        length = msg[offset] >> 1;
+        if (!(msg[offset++] & CMUX_ADDRESS_EA))
+        {
+            if (offset >= frame->data_length)
+            {
+                break;
+            }
+            length += msg[offset++] << 7;
+        }
+        if (offset + length > frame->data_length)
+        {
+            LOG_W("Dropping control message(0x%02x): value length(%d) is out of frame.", type, length);
+            break;
+        }
+        cmux_control_message(cmux, type, msg + offset, length);
+        offset += length;
+    }
+}
+
+/**
+ *  distribute the data frame of a logical channel to its virtual serial, the frame is released in fifo mode
+ *
+ * @param cmux          cmux object
+ * @param frame         the data frame
+ *
+ * @return  RT_EOK      successful
+ *          -RT_EFULL   the frame is dropped for lack of room
+ */
+static rt_err_t cmux_recv_data(struct cmux *cmux, struct cmux_frame *frame)
+{
+    rt_uint8_t channel = frame->channel;
+    rt_size_t length = frame->data_length;
+
+    if (cmux_frame_push(cmux, channel, frame) != RT_EOK)
+    {
+        cmux->stat.rx_overflows++;
+        cmux->stat.rx_overflow_bytes += length;
+        cmux_frame_destroy(cmux, frame);
+        return -RT_EFULL;
+    }
+#ifdef CMUX_USING_RX_COALESCE
+    /* the channel is notified once after the whole data has been parsed */
+    cmux->vcoms[channel].rx_pending += length;
+#else
+    cmux_vcom_isr(cmux, channel, length);
+#endif
+    return RT_EOK;
+}
+
+/**
+ * save data from serial, push frame into frame list and invoke callback function
+ *
+ * @param   device  the point of device driver structure, ppp_device structure
+ * @param   buf     the address of receive data from uart
+ * @param   len     the length of receive data
+ */
+static void cmux_recv_processdata(struct cmux *cmux, rt_uint8_t *buf, rt_size_t len)
+{
+    rt_size_t count;
+    struct cmux_frame *frame = RT_NULL;
+
+    /* frames are parsed from the data read from serial directly */
+    while (len > 0)
+    {
+        count = cmux_frame_parse(cmux, buf, len, &frame);
+        buf += count;
+        len -= count;
+        if (frame == RT_NULL)
+        {
+            continue;
+        }
+
+        /* no virtual serial for the DLCI, SABM, DISC and the other commands polling for a reply are answered
+         * with DM, data in UIH and UI frames is discarded silently */
+        if (frame->channel >= cmux->vcom_num)
+        {
+            LOG_W("Dropping frame: channel(%d) is out of CMUX_PORT_NUMBER(%d).", frame->channel, cmux->vcom_num);
+            cmux->stat.rx_channel_errors++;
+            if (CMUX_FRAME_IS(CMUX_FRAME_SABM, frame) || CMUX_FRAME_IS(CMUX_FRAME_DISC, frame) ||
+                (!frame->cr && (frame->control & CMUX_CONTROL_PF) && !CMUX_FRAME_IS(CMUX_FRAME_UIH, frame) &&
+                 !CMUX_FRAME_IS(CMUX_FRAME_UI, frame) && !CMUX_FRAME_IS(CMUX_FRAME_UA, frame) &&
+                 !CMUX_FRAME_IS(CMUX_FRAME_DM, frame)))
+            {
+                cmux_send_dm(cmux, frame->channel);
+            }
+            cmux_frame_destroy(cmux, frame);
+            continue;
+        }
+
+#ifdef CMUX_USING_ERROR_RECOVERY
+        /* I frames and supervisory frames of data channels */
+        if (cmux_erm_process(cmux, frame))
+        {
+            continue;
+        }
+#endif
+
+        /* distribute different data */
+        if ((CMUX_FRAME_IS(CMUX_FRAME_UI, frame) || CMUX_FRAME_IS(CMUX_FRAME_UIH, frame)))
+        {
+            LOG_D("this is UI or UIH frame from channel(%d).", frame->channel);
+            if (frame->channel > 0)
+            {
+                cmux_recv_data(cmux, frame);
+            }
+            else
+            {
+                /* control channel command */
+                cmux_control_process(cmux, frame);
+                cmux_frame_destroy(cmux, frame);
+            }
+        }
+        else
+        {
+            switch ((frame->control & ~CMUX_CONTROL_PF))
+            {
+            case CMUX_FRAME_UA:
+                LOG_D("This is UA frame for channel(%d).", frame->channel);
+                cmux_dlc_response(cmux, frame->channel, RT_TRUE);
+                break;
+            case CMUX_FRAME_DM:
+                LOG_D("This is DM frame for channel(%d).", frame->channel);
+                cmux_dlc_response(cmux, frame->channel, RT_FALSE);
+                break;
+            case CMUX_FRAME_SABM:
+                LOG_D("This is SABM frame for channel(%d).", frame->channel);
+                /* C/R bit is set in our own commands echoed by the modem in AT mode */
+                if (!frame->cr)
+                {
+                    cmux_dlc_remote(cmux, frame->channel, RT_TRUE);
+                }
+                break;
+            case CMUX_FRAME_DISC:
+                LOG_D("This is DISC frame for channel(%d).", frame->channel);
+                if (!frame->cr)
                 {
-                    rt_memcpy(frame->data, data, frame->data_length);
-                    data += frame->data_length;
-                    if (data == buffer->end_point)
-                        data = buffer->data;
+                    cmux_dlc_remote(cmux, frame->channel, RT_FALSE);
                 }
-                if (CMUX_FRAME_IS(CMUX_FRAME_UI, frame))
+                break;
+            }
+            cmux_frame_destroy(cmux, frame);
+        }
+    }
+
+#ifdef CMUX_USING_ERROR_RECOVERY
+    cmux_erm_ack_flush(cmux);
+#endif
+#ifdef CMUX_USING_RX_COALESCE
+    cmux_rx_notify(cmux, RT_FALSE);
+#endif
+}
+
+/**
+ *  write frames in tx buffer into actual serial, must be called with tx_lock taken
+ *
+ * @param cmux          cmux object
+ *
+ * @return  RT_EOK      successful
+ *          -RT_EIO     serial write failed
+ */
+static rt_err_t cmux_tx_flush(struct cmux *cmux)
+{
+    rt_size_t c, length = cmux->tx_length;
+
+    if (length == 0)
+    {
+        return RT_EOK;
+    }
+#ifdef CMUX_USING_TX_BATCH
+    rt_timer_stop(cmux->tx_timer);
+#endif
+    cmux->tx_length = 0;
+
+    c = rt_device_write(cmux->dev, 0, cmux->tx_buffer, length);
+    cmux->stat.tx_writes++;
+    if (c != length)
+    {
+        LOG_E("Couldn't write the whole frames to the serial port. Wrote only %d of %d bytes.", (int)c, (int)length);
+        return -RT_EIO;
+    }
+
+    return RT_EOK;
+}
+
+#ifdef CMUX_USING_TX_BATCH
+/**
+ *  timeout function of tx timer, let receive thread flush tx buffer
+ *
+ * @param parameter     cmux object
+ */
+static void cmux_tx_timeout(void *parameter)
+{
+    struct cmux *cmux = (struct cmux *)parameter;
+
+    rt_event_send(cmux->event, CMUX_EVENT_TX_FLUSH);
+}
+#endif
+
+/**
+ *  send tx buffer after a frame is appended, or let the frame wait in tx buffer for more frames, must be called with tx_lock taken
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ * @param first         the frame is the first one in tx buffer
+ *
+ * @return  RT_EOK      successful
+ *          -RT_EIO     serial write failed
+ */
+static rt_err_t cmux_tx_commit(struct cmux *cmux, int port, rt_bool_t first)
+{
+#ifdef CMUX_USING_TX_BATCH
+    /* control channel is not delayed, other frames wait for more frames at most tx_flush_time */
+    if (port != 0 && cmux->tx_flush_time > 0 && cmux->tx_length < CMUX_TX_BUFFER_SIZE)
+    {
+        if (first)
+        {
+            rt_timer_control(cmux->tx_timer, RT_TIMER_CTRL_SET_TIME, &cmux->tx_flush_time);
+            rt_timer_start(cmux->tx_timer);
+        }
+        return RT_EOK;
+    }
+#endif
+    return cmux_tx_flush(cmux);
+}
+
+/**
+ *  assemble a frame of basic option, the whole frame is sent by one write, must be called with tx_lock taken
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ * @param type          the format of cmux frame
+ * @param data          general data
+ * @param length        the length of general data
+ *
+ * @return  RT_EOK      successful
+ *          -RT_EIO     serial write failed
+ */
+static rt_err_t cmux_tx_frame_basic(struct cmux *cmux, int port, rt_uint8_t type, const char *data, int length)
+{
+    /* flag, EA=1 C port, frame type, data_length 1-2 */
+    rt_uint8_t prefix[5] = {CMUX_HEAD_FLAG, CMUX_ADDRESS_EA | CMUX_ADDRESS_CR, 0, 0, 0};
+    rt_uint8_t postfix[2] = {0xFF, CMUX_HEAD_FLAG};
+    rt_uint8_t *buffer = RT_NULL;
+    int c, prefix_length = 4, frame_length;
+
+    /* EA=1, Command, let's add address */
+    prefix[1] = prefix[1] | ((CMUX_DHCL_MASK & port) << 2);
+    /* cmux control field */
+    prefix[2] = type;
+
+    if (length > CMUX_DATA_MASK)
+    {
+        prefix_length = 5;
+        prefix[3] = ((CMUX_DATA_MASK & length) << 1);
+        prefix[4] = (CMUX_HIGH_DATA_MASK & length) >> 7;
+    }
+    else
+    {
+        prefix[3] = 1 | (length << 1);
+    }
+    /* CRC checksum */
+    postfix[0] = cmux_frame_check(prefix + 1, prefix_length - 1);
+    frame_length = prefix_length + length + 2;
+
+    /* no room for this frame, send the frames waiting in tx buffer */
+    if (cmux->tx_length + frame_length > CMUX_TX_BUFFER_SIZE)
+    {
+        if (cmux_tx_flush(cmux) != RT_EOK)
+        {
+            return -RT_EIO;
+        }
+    }
+
+    if (frame_length <= CMUX_TX_BUFFER_SIZE)
+    {
+        /* prefix, data and postfix are assembled in tx buffer, one driver call for a frame */
+        buffer = cmux->tx_buffer + cmux->tx_length;
+        rt_memcpy(buffer, prefix, prefix_length);
+        if (length > 0)
+        {
+            rt_memcpy(buffer + prefix_length, data, length);
+        }
+        rt_memcpy(buffer + prefix_length + length, postfix, 2);
+        cmux->tx_length += frame_length;
+
+        return cmux_tx_commit(cmux, port, cmux->tx_length == frame_length);
+    }
+
+    /* frame is longer than tx buffer, send it piece by piece */
+    c = rt_device_write(cmux->dev, 0, prefix, prefix_length);
+    cmux->stat.tx_writes++;
+    if (c != prefix_length)
+    {
+        LOG_E("Couldn't write the whole prefix to the serial port for the virtual port %d. Wrote only %d  bytes.", port, c);
+        return -RT_EIO;
+    }
+    c = rt_device_write(cmux->dev, 0, data, length);
+    cmux->stat.tx_writes++;
+    if (length != c)
+    {
+        LOG_E("Couldn't write all data to the serial port from the virtual port %d. Wrote only %d bytes.", port, c);
+        return -RT_EIO;
+    }
+    c = rt_device_write(cmux->dev, 0, postfix, 2);
+    cmux->stat.tx_writes++;
+    if (c != 2)
+    {
+        LOG_E("Couldn't write the whole postfix to the serial port for the virtual port %d. Wrote only %d bytes.", port, c);
+        return -RT_EIO;
+    }
+    return RT_EOK;
+}
+
+#ifdef CMUX_USING_ADVANCED_OPTION
+/**
+ *  append data to tx buffer with the transparency of advanced option, tx buffer is sent when it is full,
+ *  must be called with tx_lock taken
+ *
+ * @param cmux          cmux object
+ * @param data          the data before escaping
+ * @param length        the length of data
+ *
+ * @return  RT_EOK      successful
+ *          -RT_EIO     serial write failed
+ */
+static rt_err_t cmux_tx_escape(struct cmux *cmux, const rt_uint8_t *data, rt_size_t length)
+{
+    rt_size_t size, space;
+
+    while (length > 0)
+    {
+        space = CMUX_TX_BUFFER_SIZE - cmux->tx_length;
+        if (space < 2)
+        {
+            if (cmux_tx_flush(cmux) != RT_EOK)
+            {
+                return -RT_EIO;
+            }
+            continue;
+        }
+        /* the bytes without flag and escape octets are copied at once, the others take two bytes */
+        size = cmux_adv_scan(data, min(length, space));
+        if (size > 0)
+        {
+            rt_memcpy(cmux->tx_buffer + cmux->tx_length, data, size);
+            cmux->tx_length += size;
+            data += size;
+            length -= size;
+            continue;
+        }
+        cmux->tx_buffer[cmux->tx_length++] = CMUX_ADV_ESCAPE;
+        cmux->tx_buffer[cmux->tx_length++] = *data++ ^ CMUX_ADV_XOR;
+        length--;
+    }
+    return RT_EOK;
+}
+
+/**
+ *  assemble a frame of advanced option in tx buffer, it has no length field and its content is escaped,
+ *  must be called with tx_lock taken
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ * @param cr            C/R bit of address field, it is cleared in the responses of error recovery mode
+ * @param type          the format of cmux frame
+ * @param data          general data
+ * @param length        the length of general data
+ *
+ * @return  RT_EOK      successful
+ *          -RT_EIO     serial write failed
+ */
+static rt_err_t cmux_tx_frame_advanced(struct cmux *cmux, int port, rt_uint8_t cr, rt_uint8_t type, const char *data, int length)
+{
+    rt_uint8_t header[2], fcs;
+    rt_bool_t first;
+
+    /* EA=1, address and control field */
+    header[0] = CMUX_ADDRESS_EA | cr | ((CMUX_DHCL_MASK & port) << 2);
+    header[1] = type;
+    fcs = cmux_fcs_update(CMUX_FCS_INIT, header, 2);
+    if (CMUX_FCS_COVERS_DATA(type))
+    {
+        fcs = cmux_fcs_update(fcs, (const rt_uint8_t *)data, length);
+    }
+    fcs = 0xFF - fcs;
+
+    /* the frame may not fit when every byte is escaped, send the frames waiting in tx buffer */
+    if (cmux->tx_length + (length + 3) * 2 + 2 > CMUX_TX_BUFFER_SIZE)
+    {
+        if (cmux_tx_flush(cmux) != RT_EOK)
+        {
+            return -RT_EIO;
+        }
+    }
+
+    /* tx buffer is sent in the middle of the frame only when the frame is longer than tx buffer after escaping */
+    first = (cmux->tx_length == 0);
+    cmux->tx_buffer[cmux->tx_length++] = CMUX_ADV_FLAG;
+    if (cmux_tx_escape(cmux, header, 2) != RT_EOK ||
+            cmux_tx_escape(cmux, (const rt_uint8_t *)data, length) != RT_EOK ||
+            cmux_tx_escape(cmux, &fcs, 1) != RT_EOK)
+    {
+        LOG_E("Couldn't write the whole frame to the serial port for the virtual port %d.", port);
+        return -RT_EIO;
+    }
+    if (cmux->tx_length == CMUX_TX_BUFFER_SIZE && cmux_tx_flush(cmux) != RT_EOK)
+    {
+        return -RT_EIO;
+    }
+    cmux->tx_buffer[cmux->tx_length++] = CMUX_ADV_FLAG;
+
+    return cmux_tx_commit(cmux, port, first);
+}
+#endif
+
+#ifdef CMUX_USING_ERROR_RECOVERY
+/**
+ *  timeout function of T1 timer, let receive thread check the I frames waiting for acknowledgement
+ *
+ * @param parameter     cmux object
+ */
+static void cmux_erm_t1_timeout(void *parameter)
+{
+    struct cmux *cmux = (struct cmux *)parameter;
+
+    rt_event_send(cmux->event, CMUX_EVENT_ERM_T1);
+}
+
+/**
+ *  start T1 timer for the earliest channel waiting for acknowledgement, or stop it when no I frame is waiting,
+ *  must be called with tx_lock taken
+ *
+ * @param cmux          cmux object
+ *
+ * @return  RT_NULL
+ */
+static void cmux_erm_timer_update(struct cmux *cmux)
+{
+    struct cmux_erm *erm = RT_NULL;
+    rt_int32_t left, next = -1;
+    rt_tick_t time;
+    int i;
+
+    for (i = 1; i < cmux->vcom_num; i++)
+    {
+        erm = &cmux->vcoms[i].erm;
+        if (erm->va == erm->vs)
+        {
+            continue;
+        }
+        left = cmux_wait_left(erm->t1_start, cmux->erm_cfg.t1);
+        if (next < 0 || left < next)
+        {
+            next = left;
+        }
+    }
+
+    rt_timer_stop(cmux->erm_timer);
+    if (next >= 0)
+    {
+        time = next > 0 ? next : 1;
+        rt_timer_control(cmux->erm_timer, RT_TIMER_CTRL_SET_TIME, &time);
+        rt_timer_start(cmux->erm_timer);
+    }
+}
+
+/**
+ *  check whether a writer can take the room of window for a new I frame, must be called with interrupt disabled
+ *
+ * @param cmux          cmux object
+ * @param vcom          the virtual serial
+ *
+ * @return  RT_TRUE     error recovery mode is off, or the window has room and the modem isn't busy
+ */
+static rt_bool_t cmux_erm_window_open(struct cmux *cmux, struct cmux_vcoms *vcom)
+{
+    struct cmux_erm *erm = &vcom->erm;
+
+    if (cmux->erm_cfg.window == 0)
+    {
+        return RT_TRUE;
+    }
+    return !erm->peer_busy && CMUX_ERM_SEQ(erm->vs - erm->va) + erm->reserved < cmux->erm_cfg.window;
+}
+
+/**
+ *  send a new I frame with V(S) as N(S), a copy is kept in the slab of channel until the modem acknowledges it,
+ *  must be called with tx_lock taken
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ * @param data          general data
+ * @param length        the length of general data
+ *
+ * @return  RT_EOK      successful, the frame is sent again by T1 when serial write fails
+ */
+static rt_err_t cmux_erm_send_i(struct cmux *cmux, int port, const char *data, int length)
+{
+    struct cmux_erm *erm = &cmux->vcoms[port].erm;
+    struct cmux_erm_frame *sent = &erm->window[erm->vs];
+    rt_uint8_t control;
+    rt_base_t level;
+
+    RT_ASSERT(length <= CMUX_FRAME_SIZE_MAX);
+
+    /* at most k frames wait for acknowledgement, the block used k frames ago has been acknowledged */
+    sent->data = erm->slab + erm->slot * CMUX_FRAME_SIZE_MAX;
+    erm->slot = (erm->slot + 1) % cmux->erm_cfg.window;
+    rt_memcpy(sent->data, data, length);
+    sent->length = length;
+    control = CMUX_FRAME_I | (erm->vs << 1) | (erm->vr << 5);
+
+    /* the room taken by the writer becomes an I frame waiting for acknowledgement */
+    level = rt_hw_interrupt_disable();
+    if (erm->va == erm->vs)
+    {
+        erm->t1_start = rt_tick_get();
+        erm->retries = 0;
+    }
+    erm->vs = CMUX_ERM_SEQ(erm->vs + 1);
+    erm->reserved--;
+    rt_hw_interrupt_enable(level);
+    /* N(R) of the I frame acknowledges the frames received */
+    erm->ack_pending = RT_FALSE;
+
+    if (cmux_tx_frame_advanced(cmux, port, CMUX_ADDRESS_CR, control, data, length) != RT_EOK)
+    {
+        LOG_W("I frame %d of channel(%d) will be sent again after T1.", CMUX_ERM_NS(control), port);
+    }
+    cmux_erm_timer_update(cmux);
+
+    return RT_EOK;
+}
+#endif
+
+/**
+ *  assemble general data in the format of cmux, the whole frame is sent by one write, must be called with tx_lock taken
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ * @param type          the format of cmux frame
+ * @param data          general data
+ * @param length        the length of general data
+ *
+ * @return  length
+ */
+static rt_size_t cmux_tx_frame(struct cmux *cmux, int port, rt_uint8_t type, const char *data, int length)
+{
+    rt_err_t result;
+
+#ifdef CMUX_USING_ERROR_RECOVERY
+    if (type == CMUX_FRAME_I)
+    {
+        result = cmux_erm_send_i(cmux, port, data, length);
+    }
+    else
+#endif
+#ifdef CMUX_USING_ADVANCED_OPTION
+    if (cmux->mode == CMUX_MODE_ADVANCED)
+    {
+        result = cmux_tx_frame_advanced(cmux, port, CMUX_ADDRESS_CR, type, data, length);
+    }
+    else
+#endif
+    {
+        result = cmux_tx_frame_basic(cmux, port, type, data, length);
+    }
+    if (result != RT_EOK)
+    {
+        return 0;
+    }
+    cmux->stat.tx_frames++;
+    cmux->stat.tx_bytes += length;
+    cmux->vcoms[port].stat.tx_frames++;
+    cmux->vcoms[port].stat.tx_bytes += length;
+
+#ifdef CMUX_DEBUG
+    LOG_HEX("CMUX_TX", 32, (const rt_uint8_t *)data, length);
+#endif
+    return length;
+}
+
+/**
+ *  take the next frame to send from tx queues, must be called with tx_lock taken.
+ *  control channel has strict priority, then the channels of the highest priority share the serial by deficit round robin
+ *
+ * @param cmux          cmux object
+ *
+ * @return  the request of frame or RT_NULL when all queues are empty
+ */
+static struct cmux_tx_request *cmux_tx_dequeue(struct cmux *cmux)
+{
+    struct cmux_tx_request *request = RT_NULL;
+    struct cmux_vcoms *vcom = RT_NULL;
+    rt_base_t level;
+    int i, priority = -1;
+
+    level = rt_hw_interrupt_disable();
+    if (!rt_list_isempty(&cmux->vcoms[0].tx_list))
+    {
+        request = rt_list_entry(cmux->vcoms[0].tx_list.next, struct cmux_tx_request, list);
+        rt_list_remove(&request->list);
+        rt_hw_interrupt_enable(level);
+        return request;
+    }
+
+    /* smaller value is higher priority */
+    for (i = 1; i < cmux->vcom_num; i++)
+    {
+        vcom = &cmux->vcoms[i];
+        if (!rt_list_isempty(&vcom->tx_list) && (priority < 0 || vcom->tx_priority < priority))
+        {
+            priority = vcom->tx_priority;
+        }
+    }
+    if (priority < 0)
+    {
+        rt_hw_interrupt_enable(level);
+        return RT_NULL;
+    }
+
+    while (request == RT_NULL)
+    {
+        vcom = &cmux->vcoms[cmux->tx_turn];
+        if (cmux->tx_turn > 0 && vcom->tx_priority == priority && !rt_list_isempty(&vcom->tx_list))
+        {
+            request = rt_list_entry(vcom->tx_list.next, struct cmux_tx_request, list);
+            if (request->length <= vcom->tx_deficit)
+            {
+                rt_list_remove(&request->list);
+                vcom->tx_deficit -= request->length;
+                /* an idle channel doesn't save its quantum */
+                if (rt_list_isempty(&vcom->tx_list))
                 {
-                    for (end = 0; end < frame->data_length; end++)
-                        fcs = cmux_crctable[fcs ^ (frame->data[end])];
+                    vcom->tx_deficit = 0;
                 }
+                break;
+            }
+            request = RT_NULL;
+        }
+        else
+        {
+            vcom->tx_deficit = 0;
+        }
+
+        /* the turn of next channel, it gets the quantum of its weight */
+        cmux->tx_turn = (cmux->tx_turn + 1) % cmux->vcom_num;
+        cmux->vcoms[cmux->tx_turn].tx_deficit += cmux->vcoms[cmux->tx_turn].tx_weight * CMUX_TX_QUANTUM;
+    }
+    rt_hw_interrupt_enable(level);
+
+    return request;
+}
+
+/**
+ *  queue a frame into the tx queue of channel and wait until it is sent. the writer holding tx_lock sends the frames
+ *  of all writers in the order of scheduler until its own frame is sent, so frames are never interleaved on serial
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ * @param type          the format of cmux frame
+ * @param data          general data
+ * @param length        the length of general data
+ *
+ * @return  length
+ */
+static rt_size_t cmux_send_data(struct cmux *cmux, int port, rt_uint8_t type, const char *data, int length)
+{
+    struct cmux_tx_request request;
+    struct cmux_tx_request *next = RT_NULL;
+    rt_base_t level;
+
+    if (port >= cmux->vcom_num)
+    {
+        LOG_E("the virtual port %d is out of CMUX_PORT_NUMBER(%d).", port, cmux->vcom_num);
+        return 0;
+    }
+
+    request.port = (rt_uint8_t)port;
+    request.type = type;
+    request.data = data;
+    request.length = length;
+    request.result = 0;
+    request.done = RT_FALSE;
+
+    level = rt_hw_interrupt_disable();
+    rt_list_insert_before(&cmux->vcoms[port].tx_list, &request.list);
+    rt_hw_interrupt_enable(level);
+
+    rt_mutex_take(cmux->tx_lock, RT_WAITING_FOREVER);
+    while (!request.done)
+    {
+        next = cmux_tx_dequeue(cmux);
+        RT_ASSERT(next != RT_NULL);
+        next->result = cmux_tx_frame(cmux, next->port, next->type, next->data, next->length);
+        next->done = RT_TRUE;
+    }
+    rt_mutex_release(cmux->tx_lock);
+
+    return request.result;
+}
+
+/**
+ *  send a message on control channel
+ *
+ * @param cmux          cmux object
+ * @param type          the type of message, including C/R bit
+ * @param value         the value of message
+ * @param length        the length of value
+ *
+ * @return  the length of frame data has been sent
+ */
+static rt_size_t cmux_send_control(struct cmux *cmux, rt_uint8_t type, const rt_uint8_t *value, int length)
+{
+    rt_uint8_t msg[CMUX_CONTROL_MSG_MAX];
+    int header = 2;
+
+    if (length + 3 > CMUX_CONTROL_MSG_MAX)
+    {
+        LOG_E("control message(0x%02x) is too long(%d).", type, length);
+        return 0;
+    }
+
+    msg[0] = type | CMUX_ADDRESS_EA;
+    if (length > CMUX_DATA_MASK)
+    {
+        msg[1] = (CMUX_DATA_MASK & length) << 1;
+        msg[2] = (CMUX_HIGH_DATA_MASK & length) >> 7;
+        header = 3;
+    }
+    else
+    {
+        msg[1] = CMUX_ADDRESS_EA | (length << 1);
+    }
+    if (length > 0)
+    {
+        rt_memcpy(msg + header, value, length);
+    }
+
+    return cmux_send_data(cmux, 0, CMUX_FRAME_UIH, (const char *)msg, header + length);
+}
+
+/**
+ *  send MSC command for virtual serial, FC bit asks the modem to stop sending frames on it
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ * @param flow_off      set FC bit
+ *
+ * @return  the length of frame data has been sent
+ */
+static rt_size_t cmux_send_msc(struct cmux *cmux, int port, rt_bool_t flow_off)
+{
+    rt_uint8_t value[2];
+
+    value[0] = CMUX_ADDRESS_EA | CMUX_ADDRESS_CR | ((CMUX_DHCL_MASK & port) << 2);
+    value[1] = CMUX_ADDRESS_EA | CMUX_MSC_RTC | CMUX_MSC_RTR | CMUX_MSC_DV;
+    if (flow_off)
+    {
+        value[1] |= CMUX_MSC_FC;
+    }
+
+    return cmux_send_control(cmux, CMUX_C_MSC | CMUX_ADDRESS_CR, value, sizeof(value));
+}
+
+/**
+ *  send PN command for virtual serial before it is established, it asks for N1 of the channel
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ *
+ * @return  the length of frame data has been sent
+ */
+static rt_size_t cmux_send_pn(struct cmux *cmux, int port)
+{
+    struct cmux_vcoms *vcom = &cmux->vcoms[port];
+    rt_uint8_t value[CMUX_PN_LENGTH];
+    rt_uint32_t t1 = CMUX_PN_T1_DEFAULT;
+
+    value[0] = CMUX_DHCL_MASK & port;
+    /* frame type in the low 4 bits, convergence layer type 1 in the high 4 bits is 0 */
+    value[1] = CMUX_PN_TYPE_UIH;
+    /* the smaller value has the higher priority, the default one of 27.010 is used for the channels not set */
+    value[2] = vcom->tx_priority > 0 ? min(vcom->tx_priority, CMUX_PN_PRIORITY_MAX) : min(port | 7, 61);
+    value[6] = CMUX_PN_N2_DEFAULT;
+    value[7] = CMUX_PN_K_DEFAULT;
+#ifdef CMUX_USING_ERROR_RECOVERY
+    if (cmux->erm_cfg.window > 0)
+    {
+        value[1] = CMUX_PN_TYPE_I;
+        /* T1 is in units of 10 ms */
+        t1 = cmux->erm_cfg.t1 * 100 / RT_TICK_PER_SECOND;
+        value[6] = cmux->erm_cfg.retries;
+        value[7] = cmux->erm_cfg.window;
+    }
+#endif
+    value[3] = t1 > 0xFF ? 0xFF : (t1 == 0 ? 1 : t1);
+    value[4] = vcom->pn_frame_size & 0xFF;
+    value[5] = vcom->pn_frame_size >> 8;
+
+    return cmux_send_control(cmux, CMUX_C_PN | CMUX_ADDRESS_CR, value, sizeof(value));
+}
+
+/**
+ *  take N1 negotiated by PN for virtual serial, the byte budget of the channel follows it when it isn't set
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ * @param frame_size    N1 of the channel, 0 means N1 of the object is used
+ *
+ * @return  RT_NULL
+ */
+static void cmux_pn_apply(struct cmux *cmux, int port, rt_uint16_t frame_size)
+{
+    struct cmux_vcoms *vcom = &cmux->vcoms[port];
+    rt_uint32_t n1 = vcom->frame_size > 0 ? vcom->frame_size : CMUX_FRAME_SIZE_MAX;
+
+    if (vcom->rx_bytes_max == n1 * (CMUX_MAX_FRAME_LIST_LEN + 1))
+    {
+        n1 = frame_size > 0 ? frame_size : CMUX_FRAME_SIZE_MAX;
+        vcom->rx_bytes_max = n1 * (CMUX_MAX_FRAME_LIST_LEN + 1);
+    }
+    /* fifo mode can't queue more than the fifo */
+    if (vcom->fifo != RT_NULL)
+    {
+        vcom->rx_bytes_max = min(vcom->rx_bytes_max, CMUX_VCOM_FIFO_SIZE);
+    }
+#ifdef CMUX_USING_RX_ZERO_COPY
+    vcom->rx_bytes_max = min(vcom->rx_bytes_max, CMUX_RX_BYTES_LIMIT);
+#endif
+    if (frame_size > 0 && frame_size != vcom->frame_size)
+    {
+        LOG_D("N1 of channel(%d) is %d bytes.", port, frame_size);
+    }
+    vcom->frame_size = frame_size;
+}
+
+/**
+ *  timeout function of DLC timer, let receive thread check the channels waiting for UA
+ *
+ * @param parameter     cmux object
+ */
+static void cmux_dlc_t1_timeout(void *parameter)
+{
+    struct cmux *cmux = (struct cmux *)parameter;
+
+    rt_event_send(cmux->event, CMUX_EVENT_CHANNEL_OPEN_REQ);
+}
+
+/**
+ *  start DLC timer for the earliest channel waiting for UA, or stop it when no channel is waiting,
+ *  must be called with tx_lock taken
+ *
+ * @param cmux          cmux object
+ *
+ * @return  RT_NULL
+ */
+static void cmux_dlc_timer_update(struct cmux *cmux)
+{
+    rt_int32_t left, next = -1;
+    rt_tick_t time;
+    int i;
+
+    for (i = 0; i < cmux->vcom_num; i++)
+    {
+        if (cmux->vcoms[i].dlc_state != CMUX_DLC_OPENING && cmux->vcoms[i].dlc_state != CMUX_DLC_CLOSING)
+        {
+            continue;
+        }
+        left = cmux_wait_left(cmux->vcoms[i].dlc_start, CMUX_DLC_T1);
+        if (next < 0 || left < next)
+        {
+            next = left;
+        }
+    }
+
+    rt_timer_stop(cmux->dlc_timer);
+    if (next >= 0)
+    {
+        time = next > 0 ? next : 1;
+        rt_timer_control(cmux->dlc_timer, RT_TIMER_CTRL_SET_TIME, &time);
+        rt_timer_start(cmux->dlc_timer);
+    }
+}
+
+/**
+ *  change the state of data link connection, the threads waiting for the channel check it again
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ * @param state         CMUX_DLC_xxx
+ *
+ * @return  RT_NULL
+ */
+static void cmux_dlc_set_state(struct cmux *cmux, int port, rt_uint8_t state)
+{
+    rt_base_t level;
+
+    level = rt_hw_interrupt_disable();
+    cmux->vcoms[port].dlc_state = state;
+    rt_hw_interrupt_enable(level);
+
+    cmux_waitq_wakeup(&cmux->dlc_wait);
+    if (port > 0)
+    {
+        cmux_tx_flow_resume(cmux, port);
+    }
+}
+
+/**
+ *  send SABM or DISC for virtual serial without waiting for UA, so the channels are established back to back.
+ *  the frame is sent again when no answer arrives in T1
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ * @param state         CMUX_DLC_OPENING sends SABM, CMUX_DLC_CLOSING sends DISC
+ *
+ * @return  RT_NULL
+ */
+static void cmux_dlc_request(struct cmux *cmux, int port, rt_uint8_t state)
+{
+    struct cmux_vcoms *vcom = &cmux->vcoms[port];
+
+    rt_mutex_take(cmux->tx_lock, RT_WAITING_FOREVER);
+    vcom->dlc_retries = 0;
+    vcom->dlc_start = rt_tick_get();
+    cmux_dlc_set_state(cmux, port, state);
+    cmux_dlc_timer_update(cmux);
+    cmux_send_data(cmux, port, (state == CMUX_DLC_OPENING ? CMUX_FRAME_SABM : CMUX_FRAME_DISC) | CMUX_CONTROL_PF, RT_NULL, 0);
+    rt_mutex_release(cmux->tx_lock);
+}
+
+/**
+ *  handle UA or DM from the modem, it answers SABM or DISC of the channel
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ * @param accepted      UA is received, otherwise DM
+ *
+ * @return  RT_NULL
+ */
+static void cmux_dlc_response(struct cmux *cmux, int port, rt_bool_t accepted)
+{
+    struct cmux_vcoms *vcom = RT_NULL;
+
+    if (port >= cmux->vcom_num)
+    {
+        return;
+    }
+    vcom = &cmux->vcoms[port];
+
+    rt_mutex_take(cmux->tx_lock, RT_WAITING_FOREVER);
+    switch (vcom->dlc_state)
+    {
+    case CMUX_DLC_OPENING:
+        if (accepted)
+        {
+            LOG_D("channel(%d) has been established in %d ticks.", port, (int)(rt_tick_get() - vcom->dlc_start));
+            cmux_dlc_set_state(cmux, port, CMUX_DLC_OPEN);
+        }
+        else
+        {
+            LOG_W("the modem refuses to establish channel(%d).", port);
+            cmux->stat.dlc_failures++;
+            cmux_dlc_set_state(cmux, port, CMUX_DLC_FAILED);
+        }
+        break;
+    case CMUX_DLC_CLOSING:
+        cmux_dlc_set_state(cmux, port, CMUX_DLC_CLOSED);
+        break;
+    default:
+        /* the answer of a retry after the first one has been taken */
+        break;
+    }
+    cmux_dlc_timer_update(cmux);
+    rt_mutex_release(cmux->tx_lock);
+}
+
+/**
+ *  send DM for a DLCI without virtual serial, the frame is assembled into tx buffer directly because
+ *  the channel has no tx queue
+ *
+ * @param cmux          cmux object
+ * @param dlci          the DLCI of the command from the modem
+ *
+ * @return  RT_NULL
+ */
+static void cmux_send_dm(struct cmux *cmux, int dlci)
+{
+    rt_err_t result;
+
+    LOG_D("the modem uses channel(%d) out of CMUX_PORT_NUMBER(%d), answer DM.", dlci, cmux->vcom_num);
+    rt_mutex_take(cmux->tx_lock, RT_WAITING_FOREVER);
+#ifdef CMUX_USING_ADVANCED_OPTION
+    if (cmux->mode == CMUX_MODE_ADVANCED)
+    {
+        result = cmux_tx_frame_advanced(cmux, dlci, CMUX_ADDRESS_CR, CMUX_FRAME_DM | CMUX_CONTROL_PF, RT_NULL, 0);
+    }
+    else
+#endif
+    {
+        result = cmux_tx_frame_basic(cmux, dlci, CMUX_FRAME_DM | CMUX_CONTROL_PF, RT_NULL, 0);
+    }
+    /* the frame of a data channel may wait in tx buffer in batched mode */
+    if (result == RT_EOK && cmux_tx_flush(cmux) == RT_EOK)
+    {
+        cmux->stat.tx_frames++;
+    }
+    rt_mutex_release(cmux->tx_lock);
+}
+
+/**
+ *  handle SABM or DISC from the modem, it is answered with UA, or DM for the channel not supported
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ * @param open          SABM is received, otherwise DISC
+ *
+ * @return  RT_NULL
+ */
+static void cmux_dlc_remote(struct cmux *cmux, int port, rt_bool_t open)
+{
+    if (port >= cmux->vcom_num)
+    {
+        cmux_send_dm(cmux, port);
+        return;
+    }
+
+    rt_mutex_take(cmux->tx_lock, RT_WAITING_FOREVER);
+#ifdef CMUX_USING_ERROR_RECOVERY
+    /* both sides start from sequence number 0 again */
+    if (port > 0 && cmux->erm_cfg.window > 0)
+    {
+        cmux_erm_clear(cmux, port);
+    }
+#endif
+    cmux_send_data(cmux, port, CMUX_FRAME_UA | CMUX_CONTROL_PF, RT_NULL, 0);
+    cmux_dlc_set_state(cmux, port, open ? CMUX_DLC_OPEN : CMUX_DLC_CLOSED);
+    cmux_dlc_timer_update(cmux);
+    rt_mutex_release(cmux->tx_lock);
+}
+
+/**
+ *  send SABM or DISC again for the channels not answered in T1, the channel fails after N2 retries
+ *
+ * @param cmux          cmux object
+ *
+ * @return  RT_NULL
+ */
+static void cmux_dlc_timeout(struct cmux *cmux)
+{
+    struct cmux_vcoms *vcom = RT_NULL;
+    int i;
+
+    rt_mutex_take(cmux->tx_lock, RT_WAITING_FOREVER);
+    for (i = 0; i < cmux->vcom_num; i++)
+    {
+        vcom = &cmux->vcoms[i];
+        if ((vcom->dlc_state != CMUX_DLC_OPENING && vcom->dlc_state != CMUX_DLC_CLOSING) ||
+                cmux_wait_left(vcom->dlc_start, CMUX_DLC_T1) > 0)
+        {
+            continue;
+        }
+        if (vcom->dlc_retries >= CMUX_DLC_RETRIES)
+        {
+            if (vcom->dlc_state == CMUX_DLC_OPENING)
+            {
+                LOG_E("channel(%d) isn't established, the modem doesn't answer SABM after %d retries.", i, CMUX_DLC_RETRIES);
+                cmux->stat.dlc_failures++;
+                cmux_dlc_set_state(cmux, i, CMUX_DLC_FAILED);
             }
             else
             {
-                LOG_E("Out of memory, when allocating space for frame data.");
-                frame->data_length = 0;
+                cmux_dlc_set_state(cmux, i, CMUX_DLC_CLOSED);
+            }
+            continue;
+        }
+        vcom->dlc_retries++;
+        vcom->dlc_start = rt_tick_get();
+        cmux->stat.dlc_retries++;
+        cmux_send_data(cmux, i, (vcom->dlc_state == CMUX_DLC_OPENING ? CMUX_FRAME_SABM : CMUX_FRAME_DISC) | CMUX_CONTROL_PF,
+                       RT_NULL, 0);
+    }
+    cmux_dlc_timer_update(cmux);
+    rt_mutex_release(cmux->tx_lock);
+}
+
+/**
+ *  wait until the channel is established, or until no channel is waiting for UA when port is negative
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial, -1 means all channels
+ * @param timeout       the max ticks to wait
+ *
+ * @return  RT_EOK          the channels have been established
+ *          -RT_ETIMEOUT    some channel is still waiting for UA
+ *          -RT_ERROR       some channel has failed, or the channel isn't being established
+ */
+static rt_err_t cmux_dlc_wait(struct cmux *cmux, int port, rt_int32_t timeout)
+{
+    rt_base_t level;
+    rt_tick_t start = rt_tick_get();
+    rt_bool_t pending, failed;
+    rt_err_t result = RT_EOK;
+    int i;
+
+    while (result == RT_EOK)
+    {
+        pending = RT_FALSE;
+        failed = RT_FALSE;
+        level = rt_hw_interrupt_disable();
+        for (i = 0; i < cmux->vcom_num; i++)
+        {
+            if (port >= 0 && i != port)
+            {
+                continue;
+            }
+            if (cmux->vcoms[i].dlc_state == CMUX_DLC_OPENING)
+            {
+                pending = RT_TRUE;
+            }
+            else if (cmux->vcoms[i].dlc_state == CMUX_DLC_FAILED || (port >= 0 && cmux->vcoms[i].dlc_state != CMUX_DLC_OPEN))
+            {
+                failed = RT_TRUE;
+            }
+        }
+        if (!pending)
+        {
+            rt_hw_interrupt_enable(level);
+            return failed ? -RT_ERROR : RT_EOK;
+        }
+        result = cmux_waitq_wait(&cmux->dlc_wait, level, cmux_wait_left(start, timeout));
+    }
+
+    return result;
+}
+
+#ifdef CMUX_USING_ERROR_RECOVERY
+/**
+ *  release the I frames acknowledged by N(R) of a frame from the modem, must be called with tx_lock taken
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ * @param nr            N(R), N(S) of the next I frame the modem expects
+ *
+ * @return  RT_EOK      successful
+ *          -RT_ERROR   N(R) is out of the I frames sent, it is ignored
+ */
+static rt_err_t cmux_erm_ack(struct cmux *cmux, int port, rt_uint8_t nr)
+{
+    struct cmux_erm *erm = &cmux->vcoms[port].erm;
+    rt_base_t level;
+
+    if (CMUX_ERM_SEQ(nr - erm->va) > CMUX_ERM_SEQ(erm->vs - erm->va))
+    {
+        LOG_W("channel(%d) ignores invalid N(R) %d, V(A) %d, V(S) %d.", port, nr, erm->va, erm->vs);
+        return -RT_ERROR;
+    }
+    if (nr == erm->va)
+    {
+        return RT_EOK;
+    }
+
+    while (erm->va != nr)
+    {
+        erm->window[erm->va].data = RT_NULL;
+        erm->va = CMUX_ERM_SEQ(erm->va + 1);
+    }
+    /* T1 starts again for the I frames still waiting */
+    level = rt_hw_interrupt_disable();
+    erm->retries = 0;
+    erm->t1_start = rt_tick_get();
+    rt_hw_interrupt_enable(level);
+    cmux_tx_flow_resume(cmux, port);
+
+    return RT_EOK;
+}
+
+/**
+ *  send a supervisory frame as response, N(R) is V(R) of the channel, must be called with tx_lock taken
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ * @param type          CMUX_FRAME_RR or CMUX_FRAME_REJ
+ * @param final         set F bit to answer the P bit of modem
+ *
+ * @return  RT_NULL
+ */
+static void cmux_erm_send_s(struct cmux *cmux, int port, rt_uint8_t type, rt_bool_t final)
+{
+    struct cmux_erm *erm = &cmux->vcoms[port].erm;
+    rt_uint8_t control = type | (erm->vr << 5);
+
+    if (final)
+    {
+        control |= CMUX_CONTROL_PF;
+    }
+    erm->ack_pending = RT_FALSE;
+    cmux_tx_frame_advanced(cmux, port, 0, control, RT_NULL, 0);
+}
+
+/**
+ *  send all I frames not acknowledged again from V(A), it is go back N, must be called with tx_lock taken
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ * @param poll          set P bit in the last frame, the modem answers it even when the frames are duplicates
+ *
+ * @return  RT_NULL
+ */
+static void cmux_erm_retransmit(struct cmux *cmux, int port, rt_bool_t poll)
+{
+    struct cmux_vcoms *vcom = &cmux->vcoms[port];
+    struct cmux_erm *erm = &vcom->erm;
+    struct cmux_erm_frame *sent = RT_NULL;
+    rt_uint8_t ns, control;
+    rt_base_t level;
+
+    for (ns = erm->va; ns != erm->vs; ns = CMUX_ERM_SEQ(ns + 1))
+    {
+        sent = &erm->window[ns];
+        control = CMUX_FRAME_I | (ns << 1) | (erm->vr << 5);
+        if (poll && CMUX_ERM_SEQ(ns + 1) == erm->vs)
+        {
+            control |= CMUX_CONTROL_PF;
+        }
+        cmux_tx_frame_advanced(cmux, port, CMUX_ADDRESS_CR, control, (const char *)sent->data, sent->length);
+        cmux->stat.tx_retransmits++;
+        vcom->stat.tx_retransmits++;
+    }
+    erm->ack_pending = RT_FALSE;
+
+    level = rt_hw_interrupt_disable();
+    erm->t1_start = rt_tick_get();
+    rt_hw_interrupt_enable(level);
+}
+
+/**
+ *  clear the state of error recovery mode on a channel, the I frames not acknowledged are dropped,
+ *  must be called with tx_lock taken
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ *
+ * @return  RT_NULL
+ */
+static void cmux_erm_clear(struct cmux *cmux, int port)
+{
+    struct cmux_erm *erm = &cmux->vcoms[port].erm;
+    rt_base_t level;
+
+    while (erm->va != erm->vs)
+    {
+        erm->window[erm->va].data = RT_NULL;
+        erm->va = CMUX_ERM_SEQ(erm->va + 1);
+    }
+    erm->slot = 0;
+    /* the writers holding room of window keep it */
+    level = rt_hw_interrupt_disable();
+    erm->vs = erm->va = erm->vr = 0;
+    erm->retries = 0;
+    erm->peer_busy = RT_FALSE;
+    rt_hw_interrupt_enable(level);
+    erm->rej_sent = RT_FALSE;
+    erm->ack_pending = RT_FALSE;
+    erm->local_busy = RT_FALSE;
+    cmux_tx_flow_resume(cmux, port);
+}
+
+/**
+ *  give up the I frames not acknowledged after N2 retransmissions, the link of channel has failed.
+ *  SABM sets up the channel again, both sides start from sequence number 0, must be called with tx_lock taken
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ *
+ * @return  RT_NULL
+ */
+static void cmux_erm_discard(struct cmux *cmux, int port)
+{
+    struct cmux_erm *erm = &cmux->vcoms[port].erm;
+
+    LOG_E("channel(%d) drops %d I frames, the modem hasn't acknowledged them after %d retransmissions.",
+          port, CMUX_ERM_SEQ(erm->vs - erm->va), cmux->erm_cfg.retries);
+    cmux->stat.link_failures++;
+    cmux_erm_clear(cmux, port);
+    cmux_dlc_request(cmux, port, CMUX_DLC_OPENING);
+}
+
+/**
+ *  handle the frames of error recovery mode on data channels, I frames in sequence are pushed to the channel
+ *  and the others are dropped, supervisory frames only carry acknowledgement and busy state
+ *
+ * @param cmux          cmux object
+ * @param frame         the frame received
+ *
+ * @return  RT_TRUE     the frame has been handled and released
+ *          RT_FALSE    the frame isn't a frame of error recovery mode
+ */
+static rt_bool_t cmux_erm_process(struct cmux *cmux, struct cmux_frame *frame)
+{
+    struct cmux_erm *erm = RT_NULL;
+    rt_uint8_t control = frame->control;
+    rt_uint8_t port = frame->channel;
+    rt_bool_t accept = RT_FALSE;
+
+    if (cmux->erm_cfg.window == 0 || port == 0 || port >= cmux->vcom_num || (control & 3) == 3)
+    {
+        return RT_FALSE;
+    }
+    erm = &cmux->vcoms[port].erm;
+
+    rt_mutex_take(cmux->tx_lock, RT_WAITING_FOREVER);
+    cmux_erm_ack(cmux, port, CMUX_ERM_NR(control));
+    if ((control & 1) == CMUX_FRAME_I)
+    {
+        if (CMUX_ERM_NS(control) == erm->vr)
+        {
+            /* the modem sends it again after RR when there is room */
+            accept = !erm->local_busy;
+        }
+        else
+        {
+            cmux->stat.rx_sequence_errors++;
+            /* only one REJ is sent until the expected I frame arrives */
+            if (!erm->rej_sent && !erm->local_busy)
+            {
+                erm->rej_sent = RT_TRUE;
+                cmux->stat.tx_rejects++;
+                cmux_erm_send_s(cmux, port, CMUX_FRAME_REJ, control & CMUX_CONTROL_PF);
+                control &= ~CMUX_CONTROL_PF;
+            }
+        }
+    }
+    else
+    {
+        switch (control & ~(CMUX_CONTROL_PF | 0xE0))
+        {
+        case CMUX_FRAME_RNR:
+            erm->peer_busy = RT_TRUE;
+            break;
+        case CMUX_FRAME_REJ:
+            cmux->stat.rx_rejects++;
+            erm->peer_busy = RT_FALSE;
+            cmux_erm_retransmit(cmux, port, RT_FALSE);
+            break;
+        default:
+            /* the I frames dropped by the busy modem are sent again */
+            if (erm->peer_busy)
+            {
+                erm->peer_busy = RT_FALSE;
+                cmux_erm_retransmit(cmux, port, RT_FALSE);
             }
+            cmux_tx_flow_resume(cmux, port);
+            break;
+        }
+    }
+    cmux_erm_timer_update(cmux);
+    rt_mutex_release(cmux->tx_lock);
+
+    if (!accept)
+    {
+        cmux_frame_destroy(cmux, frame);
+    }
+    else if (cmux_recv_data(cmux, frame) != RT_EOK)
+    {
+        /* the frame dropped for lack of room is recovered by REJ when the next one arrives */
+        accept = RT_FALSE;
+    }
+
+    rt_mutex_take(cmux->tx_lock, RT_WAITING_FOREVER);
+    if (accept)
+    {
+        erm->vr = CMUX_ERM_SEQ(erm->vr + 1);
+        erm->ack_pending = RT_TRUE;
+        erm->rej_sent = RT_FALSE;
+    }
+    else if ((control & 1) == CMUX_FRAME_I && CMUX_ERM_NS(control) == erm->vr && !erm->local_busy)
+    {
+        /* the frame list is full, the modem stops until RR */
+        erm->local_busy = RT_TRUE;
+        cmux_erm_send_s(cmux, port, CMUX_FRAME_RNR, control & CMUX_CONTROL_PF);
+        control &= ~CMUX_CONTROL_PF;
+    }
+    /* P bit asks for the state of channel at once */
+    if (control & CMUX_CONTROL_PF)
+    {
+        cmux_erm_send_s(cmux, port, erm->local_busy ? CMUX_FRAME_RNR : CMUX_FRAME_RR, RT_TRUE);
+    }
+    rt_mutex_release(cmux->tx_lock);
+
+    return RT_TRUE;
+}
+
+/**
+ *  acknowledge the I frames received by RR, when no I frame has carried N(R) for them
+ *
+ * @param cmux          cmux object
+ *
+ * @return  RT_NULL
+ */
+static void cmux_erm_ack_flush(struct cmux *cmux)
+{
+    int i;
+
+    if (cmux->erm_cfg.window == 0)
+    {
+        return;
+    }
+
+    rt_mutex_take(cmux->tx_lock, RT_WAITING_FOREVER);
+    for (i = 1; i < cmux->vcom_num; i++)
+    {
+        if (cmux->vcoms[i].erm.ack_pending)
+        {
+            cmux_erm_send_s(cmux, i, CMUX_FRAME_RR, RT_FALSE);
+        }
+    }
+#ifdef CMUX_USING_TX_BATCH
+    cmux_tx_flush(cmux);
+#endif
+    rt_mutex_release(cmux->tx_lock);
+}
+
+/**
+ *  the consumer has taken data from the channel, send RR to let the modem send the I frames dropped for lack of room
+ *
+ * @param cmux          cmux object
+ * @param port          the number of virtual serial
+ *
+ * @return  RT_NULL
+ */
+static void cmux_erm_rx_ready(struct cmux *cmux, int port)
+{
+    struct cmux_erm *erm = &cmux->vcoms[port].erm;
+
+    if (!erm->local_busy)
+    {
+        return;
+    }
+
+    rt_mutex_take(cmux->tx_lock, RT_WAITING_FOREVER);
+    if (erm->local_busy)
+    {
+        erm->local_busy = RT_FALSE;
+        cmux_erm_send_s(cmux, port, CMUX_FRAME_RR, RT_FALSE);
+#ifdef CMUX_USING_TX_BATCH
+        cmux_tx_flush(cmux);
+#endif
+    }
+    rt_mutex_release(cmux->tx_lock);
+}
+
+/**
+ *  handle the expiry of T1, the I frames not acknowledged are sent again until N2 retransmissions
+ *
+ * @param cmux          cmux object
+ *
+ * @return  RT_NULL
+ */
+static void cmux_erm_timeout(struct cmux *cmux)
+{
+    struct cmux_erm *erm = RT_NULL;
+    int i;
+
+    rt_mutex_take(cmux->tx_lock, RT_WAITING_FOREVER);
+    for (i = 1; i < cmux->vcom_num; i++)
+    {
+        erm = &cmux->vcoms[i].erm;
+        if (erm->va == erm->vs || cmux_wait_left(erm->t1_start, cmux->erm_cfg.t1) > 0)
+        {
+            continue;
         }
-        /* check FCS */
-        if (cmux_crctable[fcs ^ (*data)] != 0xCF)
+        if (++erm->retries > cmux->erm_cfg.retries)
         {
-            LOG_W("Dropping frame: FCS doesn't match. Remain size: %d", cmux_buffer_length(buffer));
-            cmux_frame_destroy(frame);
-            buffer->flag_found = 0;
-            return cmux_frame_parse(buffer);
+            cmux_erm_discard(cmux, i);
         }
         else
         {
-            /* check end flag */
-            INC_BUF_POINTER(buffer, data);
-            if (*data != CMUX_HEAD_FLAG)
-            {
-                LOG_W("Dropping frame: End flag not found. Instead: %d.", *data);
-                cmux_frame_destroy(frame);
-                buffer->flag_found = 0;
-                return cmux_frame_parse(buffer);
-            }
-            else
-            {
-            }
-            INC_BUF_POINTER(buffer, data);
+            LOG_D("T1 expired on channel(%d), send I frames again from %d.", i, erm->va);
+            cmux_erm_retransmit(cmux, i, RT_TRUE);
         }
-        buffer->read_point = data;
     }
-    return frame;
+#ifdef CMUX_USING_TX_BATCH
+    cmux_tx_flush(cmux);
+#endif
+    cmux_erm_timer_update(cmux);
+    rt_mutex_release(cmux->tx_lock);
 }
 
 /**
- * save data from serial, push frame into slist and invoke callback function
+ *  reset the state of error recovery mode on all data channels, the I frames not acknowledged are dropped
  *
- * @param   device  the point of device driver structure, ppp_device structure
- * @param   buf     the address of receive data from uart
- * @param   len     the length of receive data
+ * @param cmux          cmux object
+ *
+ * @return  RT_NULL
  */
-static void cmux_recv_processdata(struct cmux *cmux, rt_uint8_t *buf, rt_size_t len)
+static void cmux_erm_reset(struct cmux *cmux)
 {
-    rt_size_t count = len;
-    struct cmux_frame *frame = RT_NULL;
+    int i;
+
+    rt_mutex_take(cmux->tx_lock, RT_WAITING_FOREVER);
+    rt_timer_stop(cmux->erm_timer);
+    for (i = 1; i < cmux->vcom_num; i++)
+    {
+        cmux_erm_clear(cmux, i);
+    }
+    rt_mutex_release(cmux->tx_lock);
+}
 
-    cmux_buffer_write(cmux->buffer, buf, count);
+/**
+ *  allocate the slab keeping the copies of I frames on every data channel, k blocks of N1 at most
+ *
+ * @param cmux          cmux object
+ * @param window        k, the window size of error recovery mode, 0 releases the slabs
+ *
+ * @return  RT_EOK      successful
+ *          -RT_ENOMEM  no memory for the slabs
+ */
+static rt_err_t cmux_erm_slab_init(struct cmux *cmux, rt_uint8_t window)
+{
+    rt_err_t result = RT_EOK;
+    int i;
 
-    while ((frame = cmux_frame_parse(cmux->buffer)) != RT_NULL)
+    rt_mutex_take(cmux->tx_lock, RT_WAITING_FOREVER);
+    for (i = 1; i < cmux->vcom_num; i++)
     {
-        /* distribute different data */
-        if ((CMUX_FRAME_IS(CMUX_FRAME_UI, frame) || CMUX_FRAME_IS(CMUX_FRAME_UIH, frame)))
+        if (cmux->vcoms[i].erm.slab != RT_NULL)
         {
-            LOG_D("this is UI or UIH frame from channel(%d).", frame->channel);
-            if (frame->channel > 0)
-            {
-                /* receive data from logical channel, distribution them */
-                cmux_frame_push(cmux, frame->channel, frame);
-                cmux_vcom_isr(cmux, frame->channel, frame->data_length);
-            }
-            else
-            {
-                /* control channel command */
-                LOG_W("control channel command haven't support.");
-                cmux_frame_destroy(frame);
-            }
+            rt_free(cmux->vcoms[i].erm.slab);
+            cmux->vcoms[i].erm.slab = RT_NULL;
         }
-        else
+        if (window > 0 && result == RT_EOK)
         {
-            switch ((frame->control & ~CMUX_CONTROL_PF))
+            cmux->vcoms[i].erm.slab = rt_malloc(window * CMUX_FRAME_SIZE_MAX);
+            if (cmux->vcoms[i].erm.slab == RT_NULL)
             {
-            case CMUX_FRAME_UA:
-                LOG_D("This is UA frame for channel(%d).", frame->channel);
-
-                break;
-            case CMUX_FRAME_DM:
-                LOG_D("This is DM frame for channel(%d).", frame->channel);
+                LOG_E("Out of memory, when keeping I frames of channel(%d) for retransmission.", i);
+                result = -RT_ENOMEM;
+            }
+        }
+    }
+    rt_mutex_release(cmux->tx_lock);
 
-                break;
-            case CMUX_FRAME_SABM:
-                LOG_D("This is SABM frame for channel(%d).", frame->channel);
+    if (result != RT_EOK)
+    {
+        cmux_erm_slab_init(cmux, 0);
+    }
+    return result;
+}
+#endif
 
-                break;
-            case CMUX_FRAME_DISC:
-                LOG_D("This is DISC frame for channel(%d).", frame->channel);
+#ifdef CMUX_USING_RX_ZERO_COPY
+/**
+ *  find the channel whose queued frames hold the most bytes of cmux buffer, must be called with interrupt disabled
+ *
+ * @param cmux          cmux object
+ *
+ * @return  the number of virtual serial, 0 when no frame data is queued
+ */
+static int cmux_recv_fullest(struct cmux *cmux)
+{
+    int i, port = 0;
 
-                break;
-            }
-            cmux_frame_destroy(frame);
+    for (i = 1; i < cmux->vcom_num; i++)
+    {
+        if (!rt_list_isempty(&cmux->vcoms[i].flist) && (port == 0 || cmux->vcoms[i].rx_queued > cmux->vcoms[port].rx_queued))
+        {
+            port = i;
         }
     }
+    return port;
 }
 
 /**
- *  assemble general data in the format of cmux
+ * Get the length that receive thread can read from serial into cmux buffer at write point, the space is contiguous.
+ * mark the buffer stalled when it is full, the data is left in serial until frames are released.
+ * when the buffer stays full for CMUX_RX_STALL_TIME, the oldest frames queued for the channel holding the most bytes
+ * are dropped, a channel nobody reads can't stop receiving the control channel
  *
- * @param dev           actual serial device
- * @param port          the number of virtual serial
- * @param type          the format of cmux frame
- * @param data          general data
- * @param length        the length of general data
+ * @param cmux    the point of cmux object structure
  *
- * @return  length
+ * @return  the length can be read
  */
-static rt_size_t cmux_send_data(struct rt_device *dev, int port, rt_uint8_t type, const char *data, int length)
+static rt_size_t cmux_recv_space(struct cmux *cmux)
 {
-    /* flag, EA=1 C port, frame type, data_length 1-2 */
-    rt_uint8_t prefix[5] = {CMUX_HEAD_FLAG, CMUX_ADDRESS_EA | CMUX_ADDRESS_CR, 0, 0, 0};
-    rt_uint8_t postfix[2] = {0xFF, CMUX_HEAD_FLAG};
-    int c, prefix_length = 4;
-
-    /* EA=1, Command, let's add address */
-    prefix[1] = prefix[1] | ((CMUX_DHCL_MASK & port) << 2);
-    /* cmux control field */
-    prefix[2] = type;
+    struct cmux_buffer *buff = cmux->buffer;
+    struct cmux_frame *frame = RT_NULL;
+    rt_size_t space;
+    rt_base_t level;
+    rt_bool_t evict = RT_FALSE;
+    int port;
 
-    if (length > CMUX_DATA_MASK)
+    while (1)
     {
-        prefix_length = 5;
-        prefix[3] = ((CMUX_DATA_MASK & length) << 1);
-        prefix[4] = (CMUX_HIGH_DATA_MASK & length) >> 7;
+        level = rt_hw_interrupt_disable();
+        cmux_buffer_hold_update(buff);
+        space = min(cmux_buffer_free(buff), buff->end_point - buff->write_point);
+        space = min(space, CMUX_RECV_READ_MAX);
+        if (space == 0 && !buff->stalled && !evict)
+        {
+            buff->stall_tick = rt_tick_get();
+            cmux->stat.rx_overflows++;
+        }
+        buff->stalled = (space == 0);
+        evict = (space == 0 && (evict || cmux_wait_left(buff->stall_tick, CMUX_RX_STALL_TIME) == 0));
+        port = evict ? cmux_recv_fullest(cmux) : 0;
+        rt_hw_interrupt_enable(level);
+
+        if (port == 0)
+        {
+            return space;
+        }
+        frame = cmux_frame_pop(cmux, port);
+        if (frame != RT_NULL)
+        {
+            LOG_W("cmux buffer is full, dropping the oldest frame (len:%d) of channel(%d).", frame->data_length, port);
+            cmux->stat.rx_overflows++;
+            cmux->stat.rx_overflow_bytes += frame->data_length;
+            cmux->vcoms[port].stat.rx_evicted++;
+            cmux_frame_destroy(cmux, frame);
+        }
     }
-    else
+}
+#endif
+
+/**
+ * read serial into cmux buffer and parse the frames until serial is drained, every read asks for all the space
+ * of cmux buffer and a short read means serial has no more data
+ *
+ * @param cmux    the point of cmux object structure
+ *
+ * @return  the length has been read
+ */
+static rt_size_t cmux_recv_drain(struct cmux *cmux)
+{
+    rt_size_t len, read_max, total = 0;
+    rt_uint8_t *buffer = RT_NULL;
+
+    do
     {
-        prefix[3] = 1 | (length << 1);
-    }
-    /* CRC checksum */
-    postfix[0] = cmux_frame_check(prefix + 1, prefix_length - 1);
+#ifdef CMUX_USING_RX_ZERO_COPY
+        /* frames still reference cmux buffer, leave data in serial until consumers release space */
+        read_max = cmux_recv_space(cmux);
+        if (read_max == 0)
+        {
+            break;
+        }
+        buffer = cmux->buffer->write_point;
+#else
+        read_max = min(CMUX_RECV_READ_MAX, CMUX_BUFFER_SIZE);
+        buffer = cmux->buffer->data;
+#endif
+        len = rt_device_read(cmux->dev, 0, buffer, read_max);
+        if (len)
+        {
+            cmux->stat.rx_bytes += len;
+            total += len;
+#ifdef CMUX_USING_RX_ZERO_COPY
+            /* the data is parsed in place, frames reference it */
+            cmux->buffer->write_point += len;
+            if (cmux->buffer->write_point == cmux->buffer->end_point)
+                cmux->buffer->write_point = cmux->buffer->data;
+#endif
+            cmux_recv_processdata(cmux, buffer, len);
+        }
 
-    c = rt_device_write(dev, 0, prefix, prefix_length);
-    if (c != prefix_length)
+    } while (len == read_max);
+
+    return total;
+}
+
+#ifdef CMUX_USING_RX_POLL
+/**
+ * switch between polling and waiting for rx_indicate by the length read in one wakeup. polling starts at 1 tick
+ * under sustained load and backs off while less data comes, rx_indicate is merged as long as polling goes on
+ *
+ * @param cmux    the point of cmux object structure
+ * @param length  the length has been read in this wakeup
+ *
+ * @return  RT_NULL
+ */
+static void cmux_recv_poll_update(struct cmux *cmux, rt_size_t length)
+{
+    cmux->rx_poll_tick = rt_tick_get();
+
+    if (length >= CMUX_RX_POLL_THRESHOLD)
     {
-        LOG_E("Couldn't write the whole prefix to the serial port for the virtual port %d. Wrote only %d  bytes.", port, c);
-        return 0;
+        cmux->rx_notified = RT_TRUE;
+        cmux->rx_poll_time = 1;
     }
-    if (length > 0)
+    else if (cmux->rx_poll_time > 0)
     {
-        c = rt_device_write(dev, 0, data, length);
-        if (length != c)
+        cmux->rx_poll_time *= 2;
+        if (cmux->rx_poll_time > CMUX_RX_POLL_TIME_MAX)
         {
-            LOG_E("Couldn't write all data to the serial port from the virtual port %d. Wrote only %d bytes.", port, c);
-            return 0;
+            /* the load is gone, data arriving before rx_indicate is allowed again is read in one more wakeup */
+            cmux->rx_poll_time = 0;
+            cmux->rx_notified = RT_FALSE;
+            rt_event_send(cmux->event, CMUX_EVENT_RX_NOTIFY);
         }
     }
-    c = rt_device_write(dev, 0, postfix, 2);
-    if (c != 2)
-    {
-        LOG_E("Couldn't write the whole postfix to the serial port for the virtual port %d. Wrote only %d bytes.", port, c);
-        return 0;
-    }
-#ifdef CMUX_DEBUG
-    LOG_HEX("CMUX_TX", 32, (const rt_uint8_t *)data, length);
-#endif
-    return length;
 }
+#endif
 
 /**
  * Receive thread , store serial data
@@ -588,26 +3714,89 @@ static rt_size_t cmux_send_data(struct rt_device *dev, int port, rt_uint8_t type
  */
 static int cmux_recv_thread(struct cmux *cmux)
 {
-    rt_uint32_t event;
-    rt_size_t len;
-    rt_uint8_t buffer[CMUX_RECV_READ_MAX];
+    rt_uint32_t event, set = CMUX_EVENT_RX_NOTIFY | CMUX_EVENT_BUFFER_RELEASE | CMUX_EVENT_TX_FLUSH | CMUX_EVENT_RX_INDICATE |
+                             CMUX_EVENT_CHANNEL_OPEN_REQ;
+    rt_int32_t timeout = RT_WAITING_FOREVER, wait;
+#ifdef CMUX_USING_RX_ZERO_COPY
+    rt_int32_t stall;
+#endif
 
+#ifdef CMUX_USING_ERROR_RECOVERY
+    set |= CMUX_EVENT_ERM_T1;
+#endif
     rt_event_control(cmux->event, RT_IPC_CMD_RESET, RT_NULL);
+    /* the notification of data coming before the thread starts has been merged, read serial once */
+    cmux->rx_notified = RT_TRUE;
+    rt_event_send(cmux->event, CMUX_EVENT_RX_NOTIFY);
 
     while (1)
     {
-        rt_event_recv(cmux->event, CMUX_EVENT_RX_NOTIFY, RT_EVENT_FLAG_OR | RT_EVENT_FLAG_CLEAR, RT_WAITING_FOREVER, &event);
-        if (event & CMUX_EVENT_RX_NOTIFY)
+#ifdef CMUX_USING_RX_POLL
+        timeout = cmux->rx_poll_time > 0 ? cmux_wait_left(cmux->rx_poll_tick, cmux->rx_poll_time) : RT_WAITING_FOREVER;
+#endif
+        wait = timeout;
+#ifdef CMUX_USING_RX_ZERO_COPY
+        /* the frames pinning cmux buffer are dropped when it stays full for CMUX_RX_STALL_TIME */
+        if (cmux->buffer->stalled)
+        {
+            stall = cmux_wait_left(cmux->buffer->stall_tick, CMUX_RX_STALL_TIME);
+            wait = (wait < 0) ? stall : min(wait, stall);
+        }
+#endif
+        event = 0;
+        rt_event_recv(cmux->event, set, RT_EVENT_FLAG_OR | RT_EVENT_FLAG_CLEAR, wait, &event);
+#ifdef CMUX_USING_RX_POLL
+        /* other events don't put off polling */
+        if (cmux->rx_poll_time > 0 && cmux_wait_left(cmux->rx_poll_tick, cmux->rx_poll_time) == 0)
+        {
+            cmux->stat.rx_polls++;
+            event |= CMUX_EVENT_RX_NOTIFY;
+        }
+#endif
+#ifdef CMUX_USING_RX_ZERO_COPY
+        if (cmux->buffer->stalled && cmux_wait_left(cmux->buffer->stall_tick, CMUX_RX_STALL_TIME) == 0)
+        {
+            event |= CMUX_EVENT_BUFFER_RELEASE;
+        }
+#endif
+        if (event & CMUX_EVENT_TX_FLUSH)
+        {
+            rt_mutex_take(cmux->tx_lock, RT_WAITING_FOREVER);
+            cmux_tx_flush(cmux);
+            rt_mutex_release(cmux->tx_lock);
+        }
+#ifdef CMUX_USING_RX_COALESCE
+        if (event & CMUX_EVENT_RX_INDICATE)
+        {
+            cmux_rx_notify(cmux, RT_TRUE);
+        }
+#endif
+        if (event & (CMUX_EVENT_RX_NOTIFY | CMUX_EVENT_BUFFER_RELEASE))
         {
-            do
+            cmux->stat.rx_wakeups++;
+            /* rx_indicate of serial after this point wakes us up again */
+#ifdef CMUX_USING_RX_POLL
+            if (cmux->rx_poll_time == 0)
+#endif
             {
-                len = rt_device_read(cmux->dev, 0, buffer, CMUX_RECV_READ_MAX);
-                if (len)
-                {
-                    cmux_recv_processdata(cmux, buffer, len);
-                }
-
-            } while (len);
+                cmux->rx_notified = RT_FALSE;
+            }
+#ifdef CMUX_USING_RX_POLL
+            cmux_recv_poll_update(cmux, cmux_recv_drain(cmux));
+#else
+            cmux_recv_drain(cmux);
+#endif
+        }
+#ifdef CMUX_USING_ERROR_RECOVERY
+        /* acknowledgements just received may have stopped T1 */
+        if (event & CMUX_EVENT_ERM_T1)
+        {
+            cmux_erm_timeout(cmux);
+        }
+#endif
+        if (event & CMUX_EVENT_CHANNEL_OPEN_REQ)
+        {
+            cmux_dlc_timeout(cmux);
         }
     }
 
@@ -627,34 +3816,59 @@ static int cmux_recv_thread(struct cmux *cmux)
  */
 rt_err_t cmux_init(struct cmux *object, const char *name, rt_uint8_t vcom_num, void *user_data)
 {
+    /* the number of cmux objects, it names the kernel objects of each cmux object */
     static rt_uint8_t count = 1;
     char tmp_name[RT_NAME_MAX] = {0};
     rt_base_t level;
+    int i;
 
-    if (_g_cmux == RT_NULL)
-    {
-        _g_cmux = object;
-    }
-    else
-    {
-        RT_ASSERT(!_g_cmux);
-    }
+    RT_ASSERT(object != RT_NULL);
 
     object->dev = rt_device_find(name);
     if (object->dev == RT_NULL)
     {
         LOG_E("cmux can't find %s.", name);
-        return RT_EOK;
+        return -RT_ERROR;
+    }
+    if (cmux_object_find(name) != RT_NULL)
+    {
+        LOG_E("cmux on %s has been initialized.", name);
+        return -RT_EBUSY;
     }
 
     object->vcom_num = vcom_num;
     object->vcoms = rt_malloc(vcom_num * sizeof(struct cmux_vcoms));
-    rt_memset(object->vcoms, 0, vcom_num * sizeof(struct cmux_vcoms));
     if (object->vcoms == RT_NULL)
     {
         LOG_E("cmux vcoms malloc failed.");
         return -RT_ENOMEM;
     }
+    rt_memset(object->vcoms, 0, vcom_num * sizeof(struct cmux_vcoms));
+    for (i = 0; i < vcom_num; i++)
+    {
+        object->vcoms[i].cmux = object;
+        /* frames may come for the channels not attached yet, they are queued until the channel is attached */
+        rt_list_init(&object->vcoms[i].flist);
+        rt_list_init(&object->vcoms[i].tx_list);
+        object->vcoms[i].tx_weight = 1;
+        object->vcoms[i].rx_policy = CMUX_RX_POLICY_FLOW_CONTROL;
+        object->vcoms[i].rx_bytes_max = CMUX_VCOM_RX_BYTES_MAX;
+#ifdef CMUX_USING_RX_ZERO_COPY
+        object->vcoms[i].rx_bytes_max = min(object->vcoms[i].rx_bytes_max, CMUX_RX_BYTES_LIMIT);
+#endif
+        cmux_waitq_init(&object->vcoms[i].rx_wait, "cmux_rx");
+        cmux_waitq_init(&object->vcoms[i].tx_wait, "cmux_tx");
+        object->vcoms[i].rx_timeout = 0;
+        object->vcoms[i].tx_timeout = CMUX_FLOW_WAIT_TIME;
+        object->vcoms[i].pn_frame_size = CMUX_PN_FRAME_SIZE;
+    }
+    object->tx_turn = 0;
+    object->rx_queued = 0;
+    object->rx_bytes_max = CMUX_RX_BYTES_MAX;
+#ifdef CMUX_USING_RX_ZERO_COPY
+    object->rx_bytes_max = min(object->rx_bytes_max, CMUX_RX_BYTES_LIMIT);
+#endif
+    object->rx_flow_off = RT_FALSE;
 
     object->buffer = cmux_buffer_init();
     if (object->buffer == RT_NULL)
@@ -662,6 +3876,21 @@ rt_err_t cmux_init(struct cmux *object, const char *name, rt_uint8_t vcom_num, v
         LOG_E("cmux buffer malloc failed.");
         return -RT_ENOMEM;
     }
+    object->frame = RT_NULL;
+    object->rx_notified = RT_FALSE;
+#ifdef CMUX_USING_RX_POLL
+    object->rx_poll_time = 0;
+    object->rx_poll_tick = 0;
+#endif
+
+#ifdef CMUX_USING_FRAME_POOL
+    object->pool = cmux_pool_init(vcom_num);
+    if (object->pool == RT_NULL)
+    {
+        LOG_E("cmux frame pool malloc failed.");
+        return -RT_ENOMEM;
+    }
+#endif
 
     rt_snprintf(tmp_name, sizeof(tmp_name), "cmux%d", count);
     object->event = rt_event_create(tmp_name, RT_IPC_FLAG_FIFO);
@@ -671,6 +3900,72 @@ rt_err_t cmux_init(struct cmux *object, const char *name, rt_uint8_t vcom_num, v
         return -RT_ENOMEM;
     }
 
+    object->tx_buffer = rt_malloc(CMUX_TX_BUFFER_SIZE);
+    if (object->tx_buffer == RT_NULL)
+    {
+        LOG_E("cmux tx buffer malloc failed.");
+        return -RT_ENOMEM;
+    }
+
+    object->tx_lock = rt_mutex_create(tmp_name, RT_IPC_FLAG_PRIO);
+    if (object->tx_lock == RT_NULL)
+    {
+        LOG_E("cmux tx lock malloc failed.");
+        return -RT_ENOMEM;
+    }
+
+#ifdef CMUX_USING_TX_BATCH
+    object->tx_timer = rt_timer_create(tmp_name, cmux_tx_timeout, object, CMUX_TX_FLUSH_TIME, RT_TIMER_FLAG_ONE_SHOT | RT_TIMER_FLAG_HARD_TIMER);
+    if (object->tx_timer == RT_NULL)
+    {
+        LOG_E("cmux tx timer malloc failed.");
+        return -RT_ENOMEM;
+    }
+    object->tx_flush_time = CMUX_TX_FLUSH_TIME;
+#endif
+    object->tx_length = 0;
+    object->frame_size = CMUX_FRAME_SIZE_MAX;
+    object->mode = CMUX_MODE_BASIC;
+
+    object->dlc_timer = rt_timer_create(tmp_name, cmux_dlc_t1_timeout, object, CMUX_DLC_T1, RT_TIMER_FLAG_ONE_SHOT | RT_TIMER_FLAG_HARD_TIMER);
+    if (object->dlc_timer == RT_NULL)
+    {
+        LOG_E("cmux DLC timer malloc failed.");
+        return -RT_ENOMEM;
+    }
+    cmux_waitq_init(&object->dlc_wait, "cmux_dlc");
+
+#ifdef CMUX_USING_ERROR_RECOVERY
+    object->erm_timer = rt_timer_create(tmp_name, cmux_erm_t1_timeout, object, CMUX_ERM_T1, RT_TIMER_FLAG_ONE_SHOT | RT_TIMER_FLAG_HARD_TIMER);
+    if (object->erm_timer == RT_NULL)
+    {
+        LOG_E("cmux T1 timer malloc failed.");
+        return -RT_ENOMEM;
+    }
+    object->erm_cfg.window = 0;
+    object->erm_cfg.retries = CMUX_ERM_RETRIES;
+    object->erm_cfg.t1 = CMUX_ERM_T1;
+#endif
+
+#ifdef CMUX_USING_RX_COALESCE
+    object->rx_timer = rt_timer_create(tmp_name, cmux_rx_timeout, object, CMUX_RX_NOTIFY_TIME, RT_TIMER_FLAG_ONE_SHOT | RT_TIMER_FLAG_HARD_TIMER);
+    if (object->rx_timer == RT_NULL)
+    {
+        LOG_E("cmux rx timer malloc failed.");
+        return -RT_ENOMEM;
+    }
+    object->rx_notify_time = CMUX_RX_NOTIFY_TIME;
+    object->rx_timer_active = RT_FALSE;
+    for (i = 0; i < vcom_num; i++)
+    {
+        object->vcoms[i].rx_threshold = CMUX_RX_NOTIFY_THRESHOLD;
+    }
+#endif
+
+    object->flow_wait_time = CMUX_FLOW_WAIT_TIME;
+    object->tx_flow_off = RT_FALSE;
+
+    rt_memset(&object->stat, 0, sizeof(struct cmux_stat));
     object->user_data = user_data;
 
     level = rt_hw_interrupt_disable();
@@ -692,6 +3987,8 @@ rt_err_t cmux_init(struct cmux *object, const char *name, rt_uint8_t vcom_num, v
         LOG_E("cmux receive thread create failed.");
         return -RT_ERROR;
     }
+    object->id = count;
+    count++;
 
     LOG_I("cmux rely on (%s) init successful.", name);
     return RT_EOK;
@@ -707,7 +4004,7 @@ rt_err_t cmux_init(struct cmux *object, const char *name, rt_uint8_t vcom_num, v
 rt_err_t cmux_start(struct cmux *object)
 {
     rt_err_t result = 0;
-    struct rt_device *device = RT_NULL;
+    char name[16] = {0};
 
     /* uart transfer into cmux */
     rt_device_set_rx_indicate(object->dev, cmux_rx_ind);
@@ -729,11 +4026,11 @@ rt_err_t cmux_start(struct cmux *object)
         }
     }
 
-    /* attach cmux control channel into rt-thread device */
-    cmux_attach(object, 0, "cmux_ctl", RT_DEVICE_OFLAG_RDWR | RT_DEVICE_FLAG_DMA_RX, RT_NULL);
+    /* attach cmux control channel into rt-thread device, it is named by the cmux object, such as cmux1ctl */
+    rt_snprintf(name, sizeof(name), "cmux%dctl", object->id);
+    cmux_attach(object, 0, name, RT_DEVICE_OFLAG_RDWR | RT_DEVICE_FLAG_DMA_RX, RT_NULL);
 
-    device = rt_device_find("cmux_ctl");
-    result = rt_device_open(device, RT_DEVICE_OFLAG_RDWR | RT_DEVICE_FLAG_DMA_RX);
+    result = rt_device_open(&object->vcoms[0].device, RT_DEVICE_OFLAG_RDWR | RT_DEVICE_FLAG_DMA_RX);
     if (result != RT_EOK)
     {
         LOG_E("cmux control channel open failed.");
@@ -757,22 +4054,296 @@ rt_err_t cmux_stop(struct cmux *object)
     }
 
     /* we should send CMUX_FRAME_DM frame, close cmux control connect channel */
-    cmux_send_data(object->dev, 0, CMUX_FRAME_DISC | CMUX_CONTROL_PF, RT_NULL, 0);
+    cmux_dlc_request(object, 0, CMUX_DLC_CLOSING);
 
     return RT_EOK;
 }
 
+/**
+ * probe the modem still in multiplexer mode after MCU reset, SABM is sent on control channel and the modem answers
+ * UA when its multiplexer session is kept, so the AT commands entering multiplexer mode can be skipped.
+ * it is called by ops->start after the actual serial is opened and before the receive thread starts,
+ * the replies are read and parsed in the calling thread
+ *
+ * @param object        the point of cmux object
+ * @param timeout       the max ticks waiting for UA, SABM is sent again every CMUX_DLC_T1
+ *
+ * @return  RT_EOK          the modem is in multiplexer mode, control channel has been established
+ *          -RT_ETIMEOUT    the modem doesn't answer UA
+ */
+rt_err_t cmux_probe(struct cmux *object, rt_int32_t timeout)
+{
+    struct cmux_vcoms *vcom = RT_NULL;
+    rt_tick_t start = rt_tick_get();
+    rt_int32_t wait;
+    rt_uint32_t event;
+
+    RT_ASSERT(object != RT_NULL);
+    vcom = &object->vcoms[0];
+
+    cmux_dlc_set_state(object, 0, CMUX_DLC_OPENING);
+    vcom->dlc_start = start - CMUX_DLC_T1;
+    do
+    {
+        if (cmux_wait_left(vcom->dlc_start, CMUX_DLC_T1) == 0)
+        {
+            vcom->dlc_start = rt_tick_get();
+            cmux_send_data(object, 0, CMUX_FRAME_SABM | CMUX_CONTROL_PF, RT_NULL, 0);
+        }
+        /* rx_indicate of serial after this point sends the event again */
+        object->rx_notified = RT_FALSE;
+        cmux_recv_drain(object);
+        if (vcom->dlc_state == CMUX_DLC_OPEN)
+        {
+            LOG_I("the modem is still in multiplexer mode, UA arrives in %d ticks.", (int)(rt_tick_get() - start));
+            return RT_EOK;
+        }
+        wait = cmux_wait_left(vcom->dlc_start, CMUX_DLC_T1);
+        if (timeout >= 0)
+        {
+            wait = min(wait, cmux_wait_left(start, timeout));
+        }
+        rt_event_recv(object->event, CMUX_EVENT_RX_NOTIFY, RT_EVENT_FLAG_OR | RT_EVENT_FLAG_CLEAR, wait, &event);
+    } while (timeout < 0 || cmux_wait_left(start, timeout) > 0);
+
+    /* the replies in AT mode may have left a partial frame */
+    cmux_frame_parse_reset(object);
+    cmux_dlc_set_state(object, 0, CMUX_DLC_CLOSED);
+    LOG_D("the modem doesn't answer SABM in %d ticks, it isn't in multiplexer mode.", (int)timeout);
+
+    return -RT_ETIMEOUT;
+}
+
+/**
+ * wait until the channels having sent SABM are established, SABMs of the channels opened are sent back to back,
+ * so they are waited for together after all of them are opened
+ *
+ * @param object        the point of cmux object
+ * @param timeout       the max ticks to wait
+ *
+ * @return  RT_EOK          all channels opened have been established
+ *          -RT_ETIMEOUT    some channel is still waiting for UA
+ *          -RT_ERROR       the modem refuses some channel or doesn't answer after N2 retries
+ */
+rt_err_t cmux_wait_open(struct cmux *object, rt_int32_t timeout)
+{
+    RT_ASSERT(object != RT_NULL);
+
+    return cmux_dlc_wait(object, -1, timeout);
+}
+
 /**
  * control cmux function
  *
  * @param object        the point of cmux object
+ * @param cmd           the command of control, CMUX_CTRL_xxx
+ * @param args          the argument of command
  *
- * @return  RT_ENOSYS   haven't support control function
+ * @return  RT_EOK      successful
+ *          RT_ENOSYS   haven't support control function
  */
 rt_err_t cmux_control(struct cmux *object, int cmd, void *args)
 {
     RT_ASSERT(object != RT_NULL);
 
+    switch (cmd)
+    {
+#ifdef CMUX_USING_TX_BATCH
+    case CMUX_CTRL_SET_TX_FLUSH_TIME:
+        RT_ASSERT(args != RT_NULL);
+        rt_mutex_take(object->tx_lock, RT_WAITING_FOREVER);
+        object->tx_flush_time = *(rt_tick_t *)args;
+        cmux_tx_flush(object);
+        rt_mutex_release(object->tx_lock);
+        return RT_EOK;
+#endif
+    case CMUX_CTRL_SET_FRAME_SIZE:
+        RT_ASSERT(args != RT_NULL);
+        if (*(rt_uint32_t *)args == 0)
+        {
+            return -RT_EINVAL;
+        }
+        if (*(rt_uint32_t *)args > CMUX_FRAME_SIZE_MAX)
+        {
+            LOG_W("N1(%d) is larger than CMUX_FRAME_SIZE_MAX(%d), frame size is limited.", *(rt_uint32_t *)args, CMUX_FRAME_SIZE_MAX);
+        }
+        object->frame_size = min(*(rt_uint32_t *)args, CMUX_FRAME_SIZE_MAX);
+        return RT_EOK;
+    case CMUX_CTRL_SET_FLOW_WAIT_TIME:
+    {
+        int i;
+
+        RT_ASSERT(args != RT_NULL);
+        /* it is the tx timeout of all virtual serials, CMUX_VCOM_CTRL_SET_TX_TIMEOUT overrides it for one */
+        object->flow_wait_time = *(rt_int32_t *)args;
+        for (i = 0; i < object->vcom_num; i++)
+        {
+            object->vcoms[i].tx_timeout = object->flow_wait_time;
+        }
+        return RT_EOK;
+    }
+    case CMUX_CTRL_SET_TX_PRIORITY:
+    {
+        struct cmux_tx_priority *priority = (struct cmux_tx_priority *)args;
+
+        RT_ASSERT(args != RT_NULL);
+        /* control channel always has the highest priority */
+        if (priority->port == 0 || priority->port >= object->vcom_num || priority->weight == 0)
+        {
+            return -RT_EINVAL;
+        }
+        rt_mutex_take(object->tx_lock, RT_WAITING_FOREVER);
+        object->vcoms[priority->port].tx_priority = priority->priority;
+        object->vcoms[priority->port].tx_weight = priority->weight;
+        rt_mutex_release(object->tx_lock);
+        return RT_EOK;
+    }
+    case CMUX_CTRL_SET_RX_POLICY:
+    {
+        struct cmux_rx_policy *policy = (struct cmux_rx_policy *)args;
+
+        RT_ASSERT(args != RT_NULL);
+        if (policy->port >= object->vcom_num || policy->policy > CMUX_RX_POLICY_FLOW_CONTROL)
+        {
+            return -RT_EINVAL;
+        }
+        object->vcoms[policy->port].rx_policy = policy->policy;
+        if (policy->bytes_max > 0)
+        {
+            object->vcoms[policy->port].rx_bytes_max = policy->bytes_max;
+        }
+        /* fifo mode can't queue more than the fifo */
+        if (object->vcoms[policy->port].fifo != RT_NULL)
+        {
+            object->vcoms[policy->port].rx_bytes_max = min(object->vcoms[policy->port].rx_bytes_max, CMUX_VCOM_FIFO_SIZE);
+        }
+#ifdef CMUX_USING_RX_ZERO_COPY
+        object->vcoms[policy->port].rx_bytes_max = min(object->vcoms[policy->port].rx_bytes_max, CMUX_RX_BYTES_LIMIT);
+#endif
+        return RT_EOK;
+    }
+    case CMUX_CTRL_SET_RX_BYTES_MAX:
+        RT_ASSERT(args != RT_NULL);
+        if (*(rt_uint32_t *)args == 0)
+        {
+            return -RT_EINVAL;
+        }
+        object->rx_bytes_max = *(rt_uint32_t *)args;
+#ifdef CMUX_USING_RX_ZERO_COPY
+        object->rx_bytes_max = min(object->rx_bytes_max, CMUX_RX_BYTES_LIMIT);
+#endif
+        return RT_EOK;
+#ifdef CMUX_USING_RX_COALESCE
+    case CMUX_CTRL_SET_RX_THRESHOLD:
+    {
+        struct cmux_rx_threshold *threshold = (struct cmux_rx_threshold *)args;
+
+        RT_ASSERT(args != RT_NULL);
+        if (threshold->port == 0 || threshold->port >= object->vcom_num)
+        {
+            return -RT_EINVAL;
+        }
+        object->vcoms[threshold->port].rx_threshold = threshold->bytes;
+        return RT_EOK;
+    }
+    case CMUX_CTRL_SET_RX_NOTIFY_TIME:
+        RT_ASSERT(args != RT_NULL);
+        object->rx_notify_time = *(rt_tick_t *)args;
+        return RT_EOK;
+#endif
+    case CMUX_CTRL_SET_RECV_PRIORITY:
+        RT_ASSERT(args != RT_NULL);
+        if (*(rt_uint8_t *)args >= RT_THREAD_PRIORITY_MAX)
+        {
+            return -RT_EINVAL;
+        }
+        return rt_thread_control(object->recv_tid, RT_THREAD_CTRL_CHANGE_PRIORITY, args);
+    case CMUX_CTRL_SET_MODE:
+        RT_ASSERT(args != RT_NULL);
+#ifdef CMUX_USING_ADVANCED_OPTION
+        if (*(rt_uint8_t *)args > CMUX_MODE_ADVANCED)
+#else
+        if (*(rt_uint8_t *)args != CMUX_MODE_BASIC)
+#endif
+        {
+            LOG_E("cmux mode(%d) isn't supported.", *(rt_uint8_t *)args);
+            return -RT_EINVAL;
+        }
+        object->mode = *(rt_uint8_t *)args;
+#ifdef CMUX_USING_ERROR_RECOVERY
+        /* error recovery mode only works in advanced option */
+        if (object->mode == CMUX_MODE_BASIC && object->erm_cfg.window > 0)
+        {
+            cmux_erm_reset(object);
+            object->erm_cfg.window = 0;
+            cmux_erm_slab_init(object, 0);
+        }
+#endif
+        /* the frame being received is in the format of the old mode */
+        cmux_frame_parse_reset(object);
+        return RT_EOK;
+    case CMUX_CTRL_SET_ERROR_RECOVERY:
+    {
+        struct cmux_erm_cfg *cfg = (struct cmux_erm_cfg *)args;
+
+        RT_ASSERT(args != RT_NULL);
+#ifdef CMUX_USING_ERROR_RECOVERY
+        if (cfg->window > CMUX_ERM_WINDOW_MAX || (cfg->window > 0 && (object->mode != CMUX_MODE_ADVANCED || cfg->t1 == 0)))
+        {
+            LOG_E("error recovery mode(k=%d, T1=%d) isn't supported in mode(%d).", cfg->window, (int)cfg->t1, object->mode);
+            return -RT_EINVAL;
+        }
+        /* both sides start from sequence number 0 when the mode is set up */
+        cmux_erm_reset(object);
+        object->erm_cfg.window = 0;
+        if (cmux_erm_slab_init(object, cfg->window) != RT_EOK)
+        {
+            return -RT_ENOMEM;
+        }
+        object->erm_cfg = *cfg;
+#else
+        if (cfg->window != 0)
+        {
+            LOG_E("error recovery mode isn't enabled, please define CMUX_USING_ERROR_RECOVERY.");
+            return -RT_EINVAL;
+        }
+#endif
+        return RT_EOK;
+    }
+    case CMUX_CTRL_GET_STAT:
+        RT_ASSERT(args != RT_NULL);
+        rt_memcpy(args, &object->stat, sizeof(struct cmux_stat));
+        return RT_EOK;
+    case CMUX_CTRL_GET_VCOM_STAT:
+    {
+        struct cmux_vcom_stat *stat = (struct cmux_vcom_stat *)args;
+        rt_uint8_t port;
+
+        RT_ASSERT(args != RT_NULL);
+        port = stat->port;
+        if (port >= object->vcom_num)
+        {
+            return -RT_EINVAL;
+        }
+        rt_memcpy(stat, &object->vcoms[port].stat, sizeof(struct cmux_vcom_stat));
+        stat->port = port;
+        return RT_EOK;
+    }
+    case CMUX_CTRL_RESET_STAT:
+    {
+        int i;
+
+        rt_memset(&object->stat, 0, sizeof(struct cmux_stat));
+        for (i = 0; i < object->vcom_num; i++)
+        {
+            rt_memset(&object->vcoms[i].stat, 0, sizeof(struct cmux_vcom_stat));
+        }
+        return RT_EOK;
+    }
+    default:
+        break;
+    }
+
     return -RT_ENOSYS;
 }
 
@@ -792,10 +4363,20 @@ static rt_err_t cmux_vcom_open(rt_device_t dev, rt_uint16_t oflag)
 
     RT_ASSERT(dev != RT_NULL);
 
-    object = _g_cmux;
+    object = vcom->cmux;
+
+    /* N1 is negotiated again, the object's one is used until the modem answers PN */
+    if (vcom->link_port > 0)
+    {
+        cmux_pn_apply(object, (int)vcom->link_port, 0);
+        if (vcom->pn_frame_size > 0)
+        {
+            cmux_send_pn(object, (int)vcom->link_port);
+        }
+    }
 
-    /* establish virtual connect channel */
-    cmux_send_data(object->dev, (int)vcom->link_port, CMUX_FRAME_SABM | CMUX_CONTROL_PF, RT_NULL, 0);
+    /* establish virtual connect channel, UA is waited for by writers or cmux_wait_open() */
+    cmux_dlc_request(object, (int)vcom->link_port, CMUX_DLC_OPENING);
 
     return result;
 }
@@ -813,22 +4394,24 @@ static rt_err_t cmux_vcom_close(rt_device_t dev)
     struct cmux *object = RT_NULL;
     struct cmux_vcoms *vcom = (struct cmux_vcoms *)dev;
 
-    object = _g_cmux;
+    object = vcom->cmux;
 
-    cmux_send_data(object->dev, (int)vcom->link_port, CMUX_FRAME_DISC | CMUX_CONTROL_PF, RT_NULL, 0);
+    cmux_dlc_request(object, (int)vcom->link_port, CMUX_DLC_CLOSING);
 
     return result;
 }
 
 /**
- * write data into virtual channel
+ * write data into virtual channel, the data is split into frames no longer than N1.
+ * writing waits while the modem stops the channel by flow control, the length has been sent is returned when
+ * flow is still off after tx_timeout
  *
  * @param dev       the point of virtual device
  * @param pos       offset
  * @param buffer    the data you want to send
  * @param size      the length of buffer
  *
- * @return  the result
+ * @return  the length has been sent
  */
 static rt_size_t cmux_vcom_write(struct rt_device *dev,
                                  rt_off_t pos,
@@ -837,23 +4420,97 @@ static rt_size_t cmux_vcom_write(struct rt_device *dev,
 {
     struct cmux *cmux = RT_NULL;
     struct cmux_vcoms *vcom = (struct cmux_vcoms *)dev;
-    rt_size_t len;
-    cmux = _g_cmux;
+    rt_size_t len, sent = 0;
+    rt_tick_t start = rt_tick_get();
+    rt_uint8_t type = CMUX_FRAME_UIH;
+    cmux = vcom->cmux;
+
+#ifdef CMUX_USING_ERROR_RECOVERY
+    /* data channels carry I frames in error recovery mode, the modem acknowledges every frame */
+    if (cmux->erm_cfg.window > 0 && vcom->link_port > 0)
+    {
+        type = CMUX_FRAME_I;
+    }
+#endif
 
     /* use virtual serial, we can write data into actual serial directly. */
-    len = cmux_send_data(cmux->dev, (int)vcom->link_port, CMUX_FRAME_UIH, buffer, size);
+    while (sent < size)
+    {
+        if (cmux_tx_flow_wait(cmux, vcom, start) != RT_EOK)
+        {
+            LOG_D("channel(%d) is stopped by flow control or isn't established, %d of %d bytes have been sent.", vcom->link_port, (int)sent, (int)size);
+            break;
+        }
+        len = min(size - sent, vcom->frame_size > 0 ? vcom->frame_size : cmux->frame_size);
+        if (cmux_send_data(cmux, (int)vcom->link_port, type, (const char *)buffer + sent, len) != len)
+        {
+            break;
+        }
+        sent += len;
+    }
+    return sent;
+}
+
+/**
+ * read the data queued for virtual channel without waiting
+ *
+ * @param cmux      cmux object
+ * @param vcom      the virtual serial
+ * @param buffer    the buffer you want to store
+ * @param size      the length of buffer
+ *
+ * @return  the length has been read
+ */
+static rt_size_t cmux_vcom_fetch(struct cmux *cmux, struct cmux_vcoms *vcom, void *buffer, rt_size_t size)
+{
+    rt_size_t len;
+
+    /* read across frame boundaries in fifo mode */
+    if (vcom->fifo != RT_NULL)
+    {
+        return cmux_fifo_read(cmux, vcom, buffer, size);
+    }
+
+    /* The previous frame has been transmitted finish. */
+    if (!vcom->frame_using_status)
+    {
+        /* support fifo, we using the first frame */
+        vcom->frame = cmux_frame_pop(cmux, (int)vcom->link_port);
+        vcom->length = 0;
+
+        /* can't find frame */
+        if (vcom->frame == RT_NULL)
+        {
+            return 0;
+        }
+        vcom->frame_using_status = 1;
+    }
+
+    /* transmit the rest of frame */
+    len = min(size, vcom->frame->data_length - vcom->length);
+    cmux_frame_read_data(cmux, vcom->frame, vcom->length, buffer, len);
+    vcom->length += len;
+
+    /* the whole frame has been read, release it */
+    if (vcom->length >= vcom->frame->data_length)
+    {
+        vcom->frame_using_status = 0;
+        cmux_frame_destroy(cmux, vcom->frame);
+        vcom->frame = RT_NULL;
+    }
+
     return len;
 }
 
 /**
- * write data into virtual channel
+ * read data from virtual channel, reading waits at most rx_timeout when no data is queued
  *
  * @param dev       the point of virtual device
  * @param pos       offset
  * @param buffer    the buffer you want to store
  * @param size      the length of buffer
  *
- * @return  the result
+ * @return  the length has been read, 0 when no data arrives in rx_timeout
  */
 static rt_size_t cmux_vcom_read(struct rt_device *dev,
                                 rt_off_t pos,
@@ -863,68 +4520,90 @@ static rt_size_t cmux_vcom_read(struct rt_device *dev,
     struct cmux_vcoms *vcom = (struct cmux_vcoms *)dev;
 
     struct cmux *cmux = RT_NULL;
-    rt_bool_t using_status = 0;
+    rt_tick_t start = rt_tick_get();
+    rt_base_t level;
+    rt_size_t len;
 
-    cmux = _g_cmux;
-    using_status = vcom->frame_using_status;
+    cmux = vcom->cmux;
 
-    /* The previous frame has been transmitted finish. */
-    if (!using_status)
+    while (1)
     {
-        /* support fifo, we using the first frame */
-        vcom->frame = cmux_frame_pop(cmux, (int)vcom->link_port);
-        vcom->length = 0;
-        vcom->data = RT_NULL;
-
-        /* can't find frame */
-        if (vcom->frame == RT_NULL)
+        len = cmux_vcom_fetch(cmux, vcom, buffer, size);
+        if (len > 0 || size == 0 || vcom->rx_timeout == 0)
         {
-            return 0;
+            break;
         }
 
-        if (size >= vcom->frame->data_length)
+        level = rt_hw_interrupt_disable();
+        if (vcom->rx_queued > 0 || !rt_list_isempty(&vcom->flist))
         {
-            int data_len = vcom->frame->data_length;
-            rt_memcpy(buffer, vcom->frame->data, data_len);
-            cmux_frame_destroy(vcom->frame);
-
-            return data_len;
+            rt_hw_interrupt_enable(level);
+            continue;
         }
-        else
+        if (cmux_waitq_wait(&vcom->rx_wait, level, cmux_wait_left(start, vcom->rx_timeout)) != RT_EOK)
         {
-            vcom->data = vcom->frame->data;
-            vcom->frame_using_status = 1;
-            rt_memcpy(buffer, vcom->data, size);
-            vcom->data = vcom->data + size;
-            vcom->length = vcom->length + size;
-
-            return size;
+            break;
         }
     }
-    else
-    {
-        /* transmit the rest of frame */
-        if (vcom->length + size >= vcom->frame->data_length)
-        {
-            size_t read_len;
-            rt_memcpy(buffer, vcom->data, vcom->frame->data_length - vcom->length);
-            vcom->frame_using_status = 0;
 
-            if (vcom->frame->data_length - vcom->length >= 0) {
-                read_len = vcom->frame->data_length - vcom->length;
-            }
-            cmux_frame_destroy(vcom->frame);
-            return read_len;
-        }
-        else
-        {
-            rt_memcpy(buffer, vcom->data, size);
-            vcom->data = vcom->data + size;
-            vcom->length = vcom->length + size;
+    return len;
+}
+
+/**
+ * control virtual channel
+ *
+ * @param dev       the point of virtual device
+ * @param cmd       CMUX_VCOM_CTRL_xxx
+ * @param args      the argument of command
+ *
+ * @return  RT_EOK          successful
+ *          -RT_ETIMEOUT    CMUX_VCOM_CTRL_WAIT_OPEN, the channel is still waiting for UA
+ *          -RT_ERROR       CMUX_VCOM_CTRL_WAIT_OPEN, the channel has failed or isn't being established
+ *          -RT_ENOSYS      the command isn't supported
+ */
+static rt_err_t cmux_vcom_control(rt_device_t dev, int cmd, void *args)
+{
+    struct cmux_vcoms *vcom = (struct cmux_vcoms *)dev;
+
+    RT_ASSERT(dev != RT_NULL);
 
-            return size;
+    switch (cmd)
+    {
+    case CMUX_VCOM_CTRL_SET_RX_TIMEOUT:
+        RT_ASSERT(args != RT_NULL);
+        vcom->rx_timeout = *(rt_int32_t *)args;
+        /* the readers waiting take the new timeout */
+        cmux_waitq_wakeup(&vcom->rx_wait);
+        return RT_EOK;
+    case CMUX_VCOM_CTRL_SET_TX_TIMEOUT:
+        RT_ASSERT(args != RT_NULL);
+        vcom->tx_timeout = *(rt_int32_t *)args;
+        cmux_waitq_wakeup(&vcom->tx_wait);
+        return RT_EOK;
+    case CMUX_VCOM_CTRL_SET_FRAME_SIZE:
+        RT_ASSERT(args != RT_NULL);
+        if (*(rt_uint32_t *)args > CMUX_FRAME_SIZE_MAX)
+        {
+            LOG_W("N1(%d) is larger than CMUX_FRAME_SIZE_MAX(%d), frame size is limited.", *(rt_uint32_t *)args, CMUX_FRAME_SIZE_MAX);
         }
+        vcom->pn_frame_size = min(*(rt_uint32_t *)args, CMUX_FRAME_SIZE_MAX);
+        return RT_EOK;
+    case CMUX_VCOM_CTRL_GET_FRAME_SIZE:
+        RT_ASSERT(args != RT_NULL);
+        *(rt_uint32_t *)args = vcom->frame_size > 0 ? vcom->frame_size : vcom->cmux->frame_size;
+        return RT_EOK;
+    case CMUX_VCOM_CTRL_GET_STATE:
+        RT_ASSERT(args != RT_NULL);
+        *(rt_uint32_t *)args = vcom->dlc_state;
+        return RT_EOK;
+    case CMUX_VCOM_CTRL_WAIT_OPEN:
+        RT_ASSERT(args != RT_NULL);
+        return cmux_dlc_wait(vcom->cmux, (int)vcom->link_port, *(rt_int32_t *)args);
+    default:
+        break;
     }
+
+    return -RT_ENOSYS;
 }
 
 /* virtual serial ops */
@@ -936,7 +4615,7 @@ const struct rt_device_ops cmux_device_ops =
     cmux_vcom_close,
     cmux_vcom_read,
     cmux_vcom_write,
-    RT_NULL,
+    cmux_vcom_control,
 };
 #endif
 
@@ -976,14 +4655,31 @@ rt_err_t cmux_attach(struct cmux *object, int link_port, const char *alias_name,
     device->close = cmux_vcom_close;
     device->read = cmux_vcom_read;
     device->write = cmux_vcom_write;
-    device->control = RT_NULL;
+    device->control = cmux_vcom_control;
 #endif
 
     object->vcoms[link_port].link_port = (rt_uint8_t)link_port;
 
-    vcoms_cmux_frame_init(object, link_port);
+    /* interrupt mode keeps frame data in a byte fifo like a serial, dma mode keeps frames in frame list */
+    if ((flags & RT_DEVICE_FLAG_INT_RX) && object->vcoms[link_port].fifo == RT_NULL)
+    {
+        object->vcoms[link_port].fifo_lock = rt_mutex_create("cmux_ff", RT_IPC_FLAG_PRIO);
+        if (object->vcoms[link_port].fifo_lock == RT_NULL)
+        {
+            LOG_E("PORT[%02d] fifo lock create failed.", link_port);
+            return -RT_ENOMEM;
+        }
+        object->vcoms[link_port].fifo = rt_ringbuffer_create(CMUX_VCOM_FIFO_SIZE);
+        if (object->vcoms[link_port].fifo == RT_NULL)
+        {
+            LOG_E("PORT[%02d] fifo malloc failed.", link_port);
+            rt_mutex_delete(object->vcoms[link_port].fifo_lock);
+            object->vcoms[link_port].fifo_lock = RT_NULL;
+            return -RT_ENOMEM;
+        }
+        object->vcoms[link_port].rx_bytes_max = min(object->vcoms[link_port].rx_bytes_max, CMUX_VCOM_FIFO_SIZE);
+    }
 
-    /* interrupt mode or dma mode is meaningless, because we don't have buffer for vcom */
     if (flags & RT_DEVICE_FLAG_INT_RX)
         rt_device_register(device, alias_name, RT_DEVICE_FLAG_RDWR | RT_DEVICE_FLAG_STREAM | RT_DEVICE_FLAG_INT_RX);
     else
@@ -1015,3 +4711,96 @@ rt_err_t cmux_detach(struct cmux *object, const char *alias_name)
 
     return RT_EOK;
 }
+
+#ifdef RT_USING_FINSH
+/**
+ * show the statistics of cmux objects, the counters are read without lock
+ *
+ * usage: cmux_stat [device name]
+ */
+static int cmux_stat(int argc, char **argv)
+{
+    struct cmux *cmux = RT_NULL;
+    struct cmux_stat *stat = RT_NULL;
+    struct cmux_vcom_stat *vstat = RT_NULL;
+    struct rt_slist_node *node = RT_NULL;
+    const char *dlc_states[] = {"closed", "opening", "open", "closing", "failed"};
+    int i;
+
+    rt_slist_for_each(node, &cmux_list)
+    {
+        cmux = rt_slist_entry(node, struct cmux, list);
+        if (argc > 1 && rt_strncmp(cmux->dev->parent.name, argv[1], RT_NAME_MAX) != 0)
+        {
+            continue;
+        }
+        stat = &cmux->stat;
+
+        rt_kprintf("cmux on %.*s\n", RT_NAME_MAX, cmux->dev->parent.name);
+        rt_kprintf("  tx: %u frames, %u bytes, %u writes\n", stat->tx_frames, stat->tx_bytes, stat->tx_writes);
+        rt_kprintf("  rx: %u frames, %u bytes, %u wakeups, %u bytes/wakeup\n", stat->rx_frames, stat->rx_bytes,
+                   stat->rx_wakeups, stat->rx_wakeups ? stat->rx_bytes / stat->rx_wakeups : 0);
+        rt_kprintf("  rx wakeups: %u per MB, %u serial notifies, %u polls\n",
+                   stat->rx_bytes ? (rt_uint32_t)((rt_uint64_t)stat->rx_wakeups * 1048576 / stat->rx_bytes) : 0,
+                   stat->rx_notifies, stat->rx_polls);
+        rt_kprintf("  rx errors: %u fcs, %u end flag, %u length, %u channel\n", stat->rx_fcs_errors, stat->rx_flag_errors,
+                   stat->rx_length_errors, stat->rx_channel_errors);
+        rt_kprintf("  rx overflows: %u, %u bytes; allocs: %u, alloc failures: %u\n", stat->rx_overflows, stat->rx_overflow_bytes,
+                   stat->rx_allocs, stat->alloc_failures);
+        rt_kprintf("  flow control: %s, %u FCoff received, %u FCoff sent\n", cmux->tx_flow_off ? "off" : "on", stat->tx_flow_offs,
+                   stat->rx_flow_offs);
+        rt_kprintf("  rx queued: %u of %u bytes\n", (rt_uint32_t)cmux->rx_queued, (rt_uint32_t)cmux->rx_bytes_max);
+#ifdef CMUX_USING_ERROR_RECOVERY
+        if (cmux->erm_cfg.window > 0)
+        {
+            rt_kprintf("  error recovery: k=%d, %u retransmits, %u REJ sent, %u REJ received, %u out of sequence, %u link failures\n",
+                       cmux->erm_cfg.window, stat->tx_retransmits, stat->tx_rejects, stat->rx_rejects, stat->rx_sequence_errors,
+                       stat->link_failures);
+        }
+#endif
+        if (stat->dlc_retries || stat->dlc_failures)
+        {
+            rt_kprintf("  DLC: %u SABM/DISC retries, %u channels failed\n", stat->dlc_retries, stat->dlc_failures);
+        }
+
+        rt_kprintf("  %-8s %4s %10s %10s %10s %10s %10s %8s %6s %13s\n", "vcom", "dlci", "rx frames", "rx bytes", "rx notify", "tx frames", "tx bytes",
+                   "dropped", "queue", "fc off rx/tx");
+        for (i = 0; i < cmux->vcom_num; i++)
+        {
+            vstat = &cmux->vcoms[i].stat;
+            if (cmux->vcoms[i].device.parent.name[0] == '\0')
+            {
+                continue;
+            }
+            rt_kprintf("  %-8.*s %4d %10u %10u %10u %10u %10u %8u %3d/%d %6u/%u\n", RT_NAME_MAX, cmux->vcoms[i].device.parent.name, i,
+                       vstat->rx_frames, vstat->rx_bytes, vstat->rx_indicates, vstat->tx_frames, vstat->tx_bytes, vstat->rx_dropped,
+                       vstat->queue_high, CMUX_MAX_FRAME_LIST_LEN + 1, vstat->rx_flow_offs, vstat->tx_flow_offs);
+#ifdef CMUX_USING_ERROR_RECOVERY
+            if (i > 0 && cmux->erm_cfg.window > 0)
+            {
+                rt_kprintf("  %8s window: V(S) %d, V(A) %d, V(R) %d, %u retransmits%s\n", "", cmux->vcoms[i].erm.vs,
+                           cmux->vcoms[i].erm.va, cmux->vcoms[i].erm.vr, vstat->tx_retransmits,
+                           cmux->vcoms[i].erm.peer_busy ? ", modem busy" : "");
+            }
+#endif
+            if (cmux->vcoms[i].dlc_state != CMUX_DLC_OPEN)
+            {
+                rt_kprintf("  %8s DLC: %s\n", "", dlc_states[cmux->vcoms[i].dlc_state]);
+            }
+            if (cmux->vcoms[i].frame_size > 0)
+            {
+                rt_kprintf("  %8s N1: %d bytes negotiated by PN\n", "", cmux->vcoms[i].frame_size);
+            }
+            if (vstat->rx_budget_drops || vstat->rx_object_drops || vstat->rx_evicted)
+            {
+                rt_kprintf("  %8s drops: %u channel budget(%u bytes), %u object budget, %u oldest; queued high %u bytes\n", "",
+                           vstat->rx_budget_drops, (rt_uint32_t)cmux->vcoms[i].rx_bytes_max, vstat->rx_object_drops,
+                           vstat->rx_evicted, vstat->queue_bytes_high);
+            }
+        }
+    }
+
+    return RT_EOK;
+}
+MSH_CMD_EXPORT(cmux_stat, show cmux statistics);
+#endif
@@ -9,6 +9,7 @@
  */
 
 #include<cmux.h>
+#include <rtthread.h>
 
 /* reversed, 8-bit, poly=0x07 */
 const rt_uint8_t cmux_crctable[256] = {
@@ -45,13 +46,371 @@ const rt_uint8_t cmux_crctable[256] = {
     0xB4, 0x25, 0x57, 0xC6, 0xB3, 0x22, 0x50, 0xC1,
     0xBA, 0x2B, 0x59, 0xC8, 0xBD, 0x2C, 0x5E, 0xCF};
 
+#if defined(CMUX_USING_FCS_SLICE_BY_8)
+#define CMUX_FCS_SLICE 8
+#elif defined(CMUX_USING_FCS_SLICE_BY_4)
+#define CMUX_FCS_SLICE 4
+#endif
+
+#ifdef CMUX_FCS_SLICE
+/* cmux_crctable_slice[k][x] is the FCS of byte x followed by (k + 1) zero bytes, several bytes are looked up in parallel */
+static const rt_uint8_t cmux_crctable_slice[CMUX_FCS_SLICE - 1][256] = {
+    {
+        0x00, 0x6D, 0xDA, 0xB7, 0x75, 0x18, 0xAF, 0xC2,
+        0xEA, 0x87, 0x30, 0x5D, 0x9F, 0xF2, 0x45, 0x28,
+        0x15, 0x78, 0xCF, 0xA2, 0x60, 0x0D, 0xBA, 0xD7,
+        0xFF, 0x92, 0x25, 0x48, 0x8A, 0xE7, 0x50, 0x3D,
+        0x2A, 0x47, 0xF0, 0x9D, 0x5F, 0x32, 0x85, 0xE8,
+        0xC0, 0xAD, 0x1A, 0x77, 0xB5, 0xD8, 0x6F, 0x02,
+        0x3F, 0x52, 0xE5, 0x88, 0x4A, 0x27, 0x90, 0xFD,
+        0xD5, 0xB8, 0x0F, 0x62, 0xA0, 0xCD, 0x7A, 0x17,
+        0x54, 0x39, 0x8E, 0xE3, 0x21, 0x4C, 0xFB, 0x96,
+        0xBE, 0xD3, 0x64, 0x09, 0xCB, 0xA6, 0x11, 0x7C,
+        0x41, 0x2C, 0x9B, 0xF6, 0x34, 0x59, 0xEE, 0x83,
+        0xAB, 0xC6, 0x71, 0x1C, 0xDE, 0xB3, 0x04, 0x69,
+        0x7E, 0x13, 0xA4, 0xC9, 0x0B, 0x66, 0xD1, 0xBC,
+        0x94, 0xF9, 0x4E, 0x23, 0xE1, 0x8C, 0x3B, 0x56,
+        0x6B, 0x06, 0xB1, 0xDC, 0x1E, 0x73, 0xC4, 0xA9,
+        0x81, 0xEC, 0x5B, 0x36, 0xF4, 0x99, 0x2E, 0x43,
+        0xA8, 0xC5, 0x72, 0x1F, 0xDD, 0xB0, 0x07, 0x6A,
+        0x42, 0x2F, 0x98, 0xF5, 0x37, 0x5A, 0xED, 0x80,
+        0xBD, 0xD0, 0x67, 0x0A, 0xC8, 0xA5, 0x12, 0x7F,
+        0x57, 0x3A, 0x8D, 0xE0, 0x22, 0x4F, 0xF8, 0x95,
+        0x82, 0xEF, 0x58, 0x35, 0xF7, 0x9A, 0x2D, 0x40,
+        0x68, 0x05, 0xB2, 0xDF, 0x1D, 0x70, 0xC7, 0xAA,
+        0x97, 0xFA, 0x4D, 0x20, 0xE2, 0x8F, 0x38, 0x55,
+        0x7D, 0x10, 0xA7, 0xCA, 0x08, 0x65, 0xD2, 0xBF,
+        0xFC, 0x91, 0x26, 0x4B, 0x89, 0xE4, 0x53, 0x3E,
+        0x16, 0x7B, 0xCC, 0xA1, 0x63, 0x0E, 0xB9, 0xD4,
+        0xE9, 0x84, 0x33, 0x5E, 0x9C, 0xF1, 0x46, 0x2B,
+        0x03, 0x6E, 0xD9, 0xB4, 0x76, 0x1B, 0xAC, 0xC1,
+        0xD6, 0xBB, 0x0C, 0x61, 0xA3, 0xCE, 0x79, 0x14,
+        0x3C, 0x51, 0xE6, 0x8B, 0x49, 0x24, 0x93, 0xFE,
+        0xC3, 0xAE, 0x19, 0x74, 0xB6, 0xDB, 0x6C, 0x01,
+        0x29, 0x44, 0xF3, 0x9E, 0x5C, 0x31, 0x86, 0xEB
+    },
+    {
+        0x00, 0xD0, 0x61, 0xB1, 0xC2, 0x12, 0xA3, 0x73,
+        0x45, 0x95, 0x24, 0xF4, 0x87, 0x57, 0xE6, 0x36,
+        0x8A, 0x5A, 0xEB, 0x3B, 0x48, 0x98, 0x29, 0xF9,
+        0xCF, 0x1F, 0xAE, 0x7E, 0x0D, 0xDD, 0x6C, 0xBC,
+        0xD5, 0x05, 0xB4, 0x64, 0x17, 0xC7, 0x76, 0xA6,
+        0x90, 0x40, 0xF1, 0x21, 0x52, 0x82, 0x33, 0xE3,
+        0x5F, 0x8F, 0x3E, 0xEE, 0x9D, 0x4D, 0xFC, 0x2C,
+        0x1A, 0xCA, 0x7B, 0xAB, 0xD8, 0x08, 0xB9, 0x69,
+        0x6B, 0xBB, 0x0A, 0xDA, 0xA9, 0x79, 0xC8, 0x18,
+        0x2E, 0xFE, 0x4F, 0x9F, 0xEC, 0x3C, 0x8D, 0x5D,
+        0xE1, 0x31, 0x80, 0x50, 0x23, 0xF3, 0x42, 0x92,
+        0xA4, 0x74, 0xC5, 0x15, 0x66, 0xB6, 0x07, 0xD7,
+        0xBE, 0x6E, 0xDF, 0x0F, 0x7C, 0xAC, 0x1D, 0xCD,
+        0xFB, 0x2B, 0x9A, 0x4A, 0x39, 0xE9, 0x58, 0x88,
+        0x34, 0xE4, 0x55, 0x85, 0xF6, 0x26, 0x97, 0x47,
+        0x71, 0xA1, 0x10, 0xC0, 0xB3, 0x63, 0xD2, 0x02,
+        0xD6, 0x06, 0xB7, 0x67, 0x14, 0xC4, 0x75, 0xA5,
+        0x93, 0x43, 0xF2, 0x22, 0x51, 0x81, 0x30, 0xE0,
+        0x5C, 0x8C, 0x3D, 0xED, 0x9E, 0x4E, 0xFF, 0x2F,
+        0x19, 0xC9, 0x78, 0xA8, 0xDB, 0x0B, 0xBA, 0x6A,
+        0x03, 0xD3, 0x62, 0xB2, 0xC1, 0x11, 0xA0, 0x70,
+        0x46, 0x96, 0x27, 0xF7, 0x84, 0x54, 0xE5, 0x35,
+        0x89, 0x59, 0xE8, 0x38, 0x4B, 0x9B, 0x2A, 0xFA,
+        0xCC, 0x1C, 0xAD, 0x7D, 0x0E, 0xDE, 0x6F, 0xBF,
+        0xBD, 0x6D, 0xDC, 0x0C, 0x7F, 0xAF, 0x1E, 0xCE,
+        0xF8, 0x28, 0x99, 0x49, 0x3A, 0xEA, 0x5B, 0x8B,
+        0x37, 0xE7, 0x56, 0x86, 0xF5, 0x25, 0x94, 0x44,
+        0x72, 0xA2, 0x13, 0xC3, 0xB0, 0x60, 0xD1, 0x01,
+        0x68, 0xB8, 0x09, 0xD9, 0xAA, 0x7A, 0xCB, 0x1B,
+        0x2D, 0xFD, 0x4C, 0x9C, 0xEF, 0x3F, 0x8E, 0x5E,
+        0xE2, 0x32, 0x83, 0x53, 0x20, 0xF0, 0x41, 0x91,
+        0xA7, 0x77, 0xC6, 0x16, 0x65, 0xB5, 0x04, 0xD4
+    },
+    {
+        0x00, 0x8C, 0xD9, 0x55, 0x73, 0xFF, 0xAA, 0x26,
+        0xE6, 0x6A, 0x3F, 0xB3, 0x95, 0x19, 0x4C, 0xC0,
+        0x0D, 0x81, 0xD4, 0x58, 0x7E, 0xF2, 0xA7, 0x2B,
+        0xEB, 0x67, 0x32, 0xBE, 0x98, 0x14, 0x41, 0xCD,
+        0x1A, 0x96, 0xC3, 0x4F, 0x69, 0xE5, 0xB0, 0x3C,
+        0xFC, 0x70, 0x25, 0xA9, 0x8F, 0x03, 0x56, 0xDA,
+        0x17, 0x9B, 0xCE, 0x42, 0x64, 0xE8, 0xBD, 0x31,
+        0xF1, 0x7D, 0x28, 0xA4, 0x82, 0x0E, 0x5B, 0xD7,
+        0x34, 0xB8, 0xED, 0x61, 0x47, 0xCB, 0x9E, 0x12,
+        0xD2, 0x5E, 0x0B, 0x87, 0xA1, 0x2D, 0x78, 0xF4,
+        0x39, 0xB5, 0xE0, 0x6C, 0x4A, 0xC6, 0x93, 0x1F,
+        0xDF, 0x53, 0x06, 0x8A, 0xAC, 0x20, 0x75, 0xF9,
+        0x2E, 0xA2, 0xF7, 0x7B, 0x5D, 0xD1, 0x84, 0x08,
+        0xC8, 0x44, 0x11, 0x9D, 0xBB, 0x37, 0x62, 0xEE,
+        0x23, 0xAF, 0xFA, 0x76, 0x50, 0xDC, 0x89, 0x05,
+        0xC5, 0x49, 0x1C, 0x90, 0xB6, 0x3A, 0x6F, 0xE3,
+        0x68, 0xE4, 0xB1, 0x3D, 0x1B, 0x97, 0xC2, 0x4E,
+        0x8E, 0x02, 0x57, 0xDB, 0xFD, 0x71, 0x24, 0xA8,
+        0x65, 0xE9, 0xBC, 0x30, 0x16, 0x9A, 0xCF, 0x43,
+        0x83, 0x0F, 0x5A, 0xD6, 0xF0, 0x7C, 0x29, 0xA5,
+        0x72, 0xFE, 0xAB, 0x27, 0x01, 0x8D, 0xD8, 0x54,
+        0x94, 0x18, 0x4D, 0xC1, 0xE7, 0x6B, 0x3E, 0xB2,
+        0x7F, 0xF3, 0xA6, 0x2A, 0x0C, 0x80, 0xD5, 0x59,
+        0x99, 0x15, 0x40, 0xCC, 0xEA, 0x66, 0x33, 0xBF,
+        0x5C, 0xD0, 0x85, 0x09, 0x2F, 0xA3, 0xF6, 0x7A,
+        0xBA, 0x36, 0x63, 0xEF, 0xC9, 0x45, 0x10, 0x9C,
+        0x51, 0xDD, 0x88, 0x04, 0x22, 0xAE, 0xFB, 0x77,
+        0xB7, 0x3B, 0x6E, 0xE2, 0xC4, 0x48, 0x1D, 0x91,
+        0x46, 0xCA, 0x9F, 0x13, 0x35, 0xB9, 0xEC, 0x60,
+        0xA0, 0x2C, 0x79, 0xF5, 0xD3, 0x5F, 0x0A, 0x86,
+        0x4B, 0xC7, 0x92, 0x1E, 0x38, 0xB4, 0xE1, 0x6D,
+        0xAD, 0x21, 0x74, 0xF8, 0xDE, 0x52, 0x07, 0x8B
+    },
+#if CMUX_FCS_SLICE == 8
+    {
+        0x00, 0xE9, 0x13, 0xFA, 0x26, 0xCF, 0x35, 0xDC,
+        0x4C, 0xA5, 0x5F, 0xB6, 0x6A, 0x83, 0x79, 0x90,
+        0x98, 0x71, 0x8B, 0x62, 0xBE, 0x57, 0xAD, 0x44,
+        0xD4, 0x3D, 0xC7, 0x2E, 0xF2, 0x1B, 0xE1, 0x08,
+        0xF1, 0x18, 0xE2, 0x0B, 0xD7, 0x3E, 0xC4, 0x2D,
+        0xBD, 0x54, 0xAE, 0x47, 0x9B, 0x72, 0x88, 0x61,
+        0x69, 0x80, 0x7A, 0x93, 0x4F, 0xA6, 0x5C, 0xB5,
+        0x25, 0xCC, 0x36, 0xDF, 0x03, 0xEA, 0x10, 0xF9,
+        0x23, 0xCA, 0x30, 0xD9, 0x05, 0xEC, 0x16, 0xFF,
+        0x6F, 0x86, 0x7C, 0x95, 0x49, 0xA0, 0x5A, 0xB3,
+        0xBB, 0x52, 0xA8, 0x41, 0x9D, 0x74, 0x8E, 0x67,
+        0xF7, 0x1E, 0xE4, 0x0D, 0xD1, 0x38, 0xC2, 0x2B,
+        0xD2, 0x3B, 0xC1, 0x28, 0xF4, 0x1D, 0xE7, 0x0E,
+        0x9E, 0x77, 0x8D, 0x64, 0xB8, 0x51, 0xAB, 0x42,
+        0x4A, 0xA3, 0x59, 0xB0, 0x6C, 0x85, 0x7F, 0x96,
+        0x06, 0xEF, 0x15, 0xFC, 0x20, 0xC9, 0x33, 0xDA,
+        0x46, 0xAF, 0x55, 0xBC, 0x60, 0x89, 0x73, 0x9A,
+        0x0A, 0xE3, 0x19, 0xF0, 0x2C, 0xC5, 0x3F, 0xD6,
+        0xDE, 0x37, 0xCD, 0x24, 0xF8, 0x11, 0xEB, 0x02,
+        0x92, 0x7B, 0x81, 0x68, 0xB4, 0x5D, 0xA7, 0x4E,
+        0xB7, 0x5E, 0xA4, 0x4D, 0x91, 0x78, 0x82, 0x6B,
+        0xFB, 0x12, 0xE8, 0x01, 0xDD, 0x34, 0xCE, 0x27,
+        0x2F, 0xC6, 0x3C, 0xD5, 0x09, 0xE0, 0x1A, 0xF3,
+        0x63, 0x8A, 0x70, 0x99, 0x45, 0xAC, 0x56, 0xBF,
+        0x65, 0x8C, 0x76, 0x9F, 0x43, 0xAA, 0x50, 0xB9,
+        0x29, 0xC0, 0x3A, 0xD3, 0x0F, 0xE6, 0x1C, 0xF5,
+        0xFD, 0x14, 0xEE, 0x07, 0xDB, 0x32, 0xC8, 0x21,
+        0xB1, 0x58, 0xA2, 0x4B, 0x97, 0x7E, 0x84, 0x6D,
+        0x94, 0x7D, 0x87, 0x6E, 0xB2, 0x5B, 0xA1, 0x48,
+        0xD8, 0x31, 0xCB, 0x22, 0xFE, 0x17, 0xED, 0x04,
+        0x0C, 0xE5, 0x1F, 0xF6, 0x2A, 0xC3, 0x39, 0xD0,
+        0x40, 0xA9, 0x53, 0xBA, 0x66, 0x8F, 0x75, 0x9C
+    },
+    {
+        0x00, 0x37, 0x6E, 0x59, 0xDC, 0xEB, 0xB2, 0x85,
+        0x79, 0x4E, 0x17, 0x20, 0xA5, 0x92, 0xCB, 0xFC,
+        0xF2, 0xC5, 0x9C, 0xAB, 0x2E, 0x19, 0x40, 0x77,
+        0x8B, 0xBC, 0xE5, 0xD2, 0x57, 0x60, 0x39, 0x0E,
+        0x25, 0x12, 0x4B, 0x7C, 0xF9, 0xCE, 0x97, 0xA0,
+        0x5C, 0x6B, 0x32, 0x05, 0x80, 0xB7, 0xEE, 0xD9,
+        0xD7, 0xE0, 0xB9, 0x8E, 0x0B, 0x3C, 0x65, 0x52,
+        0xAE, 0x99, 0xC0, 0xF7, 0x72, 0x45, 0x1C, 0x2B,
+        0x4A, 0x7D, 0x24, 0x13, 0x96, 0xA1, 0xF8, 0xCF,
+        0x33, 0x04, 0x5D, 0x6A, 0xEF, 0xD8, 0x81, 0xB6,
+        0xB8, 0x8F, 0xD6, 0xE1, 0x64, 0x53, 0x0A, 0x3D,
+        0xC1, 0xF6, 0xAF, 0x98, 0x1D, 0x2A, 0x73, 0x44,
+        0x6F, 0x58, 0x01, 0x36, 0xB3, 0x84, 0xDD, 0xEA,
+        0x16, 0x21, 0x78, 0x4F, 0xCA, 0xFD, 0xA4, 0x93,
+        0x9D, 0xAA, 0xF3, 0xC4, 0x41, 0x76, 0x2F, 0x18,
+        0xE4, 0xD3, 0x8A, 0xBD, 0x38, 0x0F, 0x56, 0x61,
+        0x94, 0xA3, 0xFA, 0xCD, 0x48, 0x7F, 0x26, 0x11,
+        0xED, 0xDA, 0x83, 0xB4, 0x31, 0x06, 0x5F, 0x68,
+        0x66, 0x51, 0x08, 0x3F, 0xBA, 0x8D, 0xD4, 0xE3,
+        0x1F, 0x28, 0x71, 0x46, 0xC3, 0xF4, 0xAD, 0x9A,
+        0xB1, 0x86, 0xDF, 0xE8, 0x6D, 0x5A, 0x03, 0x34,
+        0xC8, 0xFF, 0xA6, 0x91, 0x14, 0x23, 0x7A, 0x4D,
+        0x43, 0x74, 0x2D, 0x1A, 0x9F, 0xA8, 0xF1, 0xC6,
+        0x3A, 0x0D, 0x54, 0x63, 0xE6, 0xD1, 0x88, 0xBF,
+        0xDE, 0xE9, 0xB0, 0x87, 0x02, 0x35, 0x6C, 0x5B,
+        0xA7, 0x90, 0xC9, 0xFE, 0x7B, 0x4C, 0x15, 0x22,
+        0x2C, 0x1B, 0x42, 0x75, 0xF0, 0xC7, 0x9E, 0xA9,
+        0x55, 0x62, 0x3B, 0x0C, 0x89, 0xBE, 0xE7, 0xD0,
+        0xFB, 0xCC, 0x95, 0xA2, 0x27, 0x10, 0x49, 0x7E,
+        0x82, 0xB5, 0xEC, 0xDB, 0x5E, 0x69, 0x30, 0x07,
+        0x09, 0x3E, 0x67, 0x50, 0xD5, 0xE2, 0xBB, 0x8C,
+        0x70, 0x47, 0x1E, 0x29, 0xAC, 0x9B, 0xC2, 0xF5
+    },
+    {
+        0x00, 0x51, 0xA2, 0xF3, 0x85, 0xD4, 0x27, 0x76,
+        0xCB, 0x9A, 0x69, 0x38, 0x4E, 0x1F, 0xEC, 0xBD,
+        0x57, 0x06, 0xF5, 0xA4, 0xD2, 0x83, 0x70, 0x21,
+        0x9C, 0xCD, 0x3E, 0x6F, 0x19, 0x48, 0xBB, 0xEA,
+        0xAE, 0xFF, 0x0C, 0x5D, 0x2B, 0x7A, 0x89, 0xD8,
+        0x65, 0x34, 0xC7, 0x96, 0xE0, 0xB1, 0x42, 0x13,
+        0xF9, 0xA8, 0x5B, 0x0A, 0x7C, 0x2D, 0xDE, 0x8F,
+        0x32, 0x63, 0x90, 0xC1, 0xB7, 0xE6, 0x15, 0x44,
+        0x9D, 0xCC, 0x3F, 0x6E, 0x18, 0x49, 0xBA, 0xEB,
+        0x56, 0x07, 0xF4, 0xA5, 0xD3, 0x82, 0x71, 0x20,
+        0xCA, 0x9B, 0x68, 0x39, 0x4F, 0x1E, 0xED, 0xBC,
+        0x01, 0x50, 0xA3, 0xF2, 0x84, 0xD5, 0x26, 0x77,
+        0x33, 0x62, 0x91, 0xC0, 0xB6, 0xE7, 0x14, 0x45,
+        0xF8, 0xA9, 0x5A, 0x0B, 0x7D, 0x2C, 0xDF, 0x8E,
+        0x64, 0x35, 0xC6, 0x97, 0xE1, 0xB0, 0x43, 0x12,
+        0xAF, 0xFE, 0x0D, 0x5C, 0x2A, 0x7B, 0x88, 0xD9,
+        0xFB, 0xAA, 0x59, 0x08, 0x7E, 0x2F, 0xDC, 0x8D,
+        0x30, 0x61, 0x92, 0xC3, 0xB5, 0xE4, 0x17, 0x46,
+        0xAC, 0xFD, 0x0E, 0x5F, 0x29, 0x78, 0x8B, 0xDA,
+        0x67, 0x36, 0xC5, 0x94, 0xE2, 0xB3, 0x40, 0x11,
+        0x55, 0x04, 0xF7, 0xA6, 0xD0, 0x81, 0x72, 0x23,
+        0x9E, 0xCF, 0x3C, 0x6D, 0x1B, 0x4A, 0xB9, 0xE8,
+        0x02, 0x53, 0xA0, 0xF1, 0x87, 0xD6, 0x25, 0x74,
+        0xC9, 0x98, 0x6B, 0x3A, 0x4C, 0x1D, 0xEE, 0xBF,
+        0x66, 0x37, 0xC4, 0x95, 0xE3, 0xB2, 0x41, 0x10,
+        0xAD, 0xFC, 0x0F, 0x5E, 0x28, 0x79, 0x8A, 0xDB,
+        0x31, 0x60, 0x93, 0xC2, 0xB4, 0xE5, 0x16, 0x47,
+        0xFA, 0xAB, 0x58, 0x09, 0x7F, 0x2E, 0xDD, 0x8C,
+        0xC8, 0x99, 0x6A, 0x3B, 0x4D, 0x1C, 0xEF, 0xBE,
+        0x03, 0x52, 0xA1, 0xF0, 0x86, 0xD7, 0x24, 0x75,
+        0x9F, 0xCE, 0x3D, 0x6C, 0x1A, 0x4B, 0xB8, 0xE9,
+        0x54, 0x05, 0xF6, 0xA7, 0xD1, 0x80, 0x73, 0x22
+    },
+    {
+        0x00, 0xFD, 0x3B, 0xC6, 0x76, 0x8B, 0x4D, 0xB0,
+        0xEC, 0x11, 0xD7, 0x2A, 0x9A, 0x67, 0xA1, 0x5C,
+        0x19, 0xE4, 0x22, 0xDF, 0x6F, 0x92, 0x54, 0xA9,
+        0xF5, 0x08, 0xCE, 0x33, 0x83, 0x7E, 0xB8, 0x45,
+        0x32, 0xCF, 0x09, 0xF4, 0x44, 0xB9, 0x7F, 0x82,
+        0xDE, 0x23, 0xE5, 0x18, 0xA8, 0x55, 0x93, 0x6E,
+        0x2B, 0xD6, 0x10, 0xED, 0x5D, 0xA0, 0x66, 0x9B,
+        0xC7, 0x3A, 0xFC, 0x01, 0xB1, 0x4C, 0x8A, 0x77,
+        0x64, 0x99, 0x5F, 0xA2, 0x12, 0xEF, 0x29, 0xD4,
+        0x88, 0x75, 0xB3, 0x4E, 0xFE, 0x03, 0xC5, 0x38,
+        0x7D, 0x80, 0x46, 0xBB, 0x0B, 0xF6, 0x30, 0xCD,
+        0x91, 0x6C, 0xAA, 0x57, 0xE7, 0x1A, 0xDC, 0x21,
+        0x56, 0xAB, 0x6D, 0x90, 0x20, 0xDD, 0x1B, 0xE6,
+        0xBA, 0x47, 0x81, 0x7C, 0xCC, 0x31, 0xF7, 0x0A,
+        0x4F, 0xB2, 0x74, 0x89, 0x39, 0xC4, 0x02, 0xFF,
+        0xA3, 0x5E, 0x98, 0x65, 0xD5, 0x28, 0xEE, 0x13,
+        0xC8, 0x35, 0xF3, 0x0E, 0xBE, 0x43, 0x85, 0x78,
+        0x24, 0xD9, 0x1F, 0xE2, 0x52, 0xAF, 0x69, 0x94,
+        0xD1, 0x2C, 0xEA, 0x17, 0xA7, 0x5A, 0x9C, 0x61,
+        0x3D, 0xC0, 0x06, 0xFB, 0x4B, 0xB6, 0x70, 0x8D,
+        0xFA, 0x07, 0xC1, 0x3C, 0x8C, 0x71, 0xB7, 0x4A,
+        0x16, 0xEB, 0x2D, 0xD0, 0x60, 0x9D, 0x5B, 0xA6,
+        0xE3, 0x1E, 0xD8, 0x25, 0x95, 0x68, 0xAE, 0x53,
+        0x0F, 0xF2, 0x34, 0xC9, 0x79, 0x84, 0x42, 0xBF,
+        0xAC, 0x51, 0x97, 0x6A, 0xDA, 0x27, 0xE1, 0x1C,
+        0x40, 0xBD, 0x7B, 0x86, 0x36, 0xCB, 0x0D, 0xF0,
+        0xB5, 0x48, 0x8E, 0x73, 0xC3, 0x3E, 0xF8, 0x05,
+        0x59, 0xA4, 0x62, 0x9F, 0x2F, 0xD2, 0x14, 0xE9,
+        0x9E, 0x63, 0xA5, 0x58, 0xE8, 0x15, 0xD3, 0x2E,
+        0x72, 0x8F, 0x49, 0xB4, 0x04, 0xF9, 0x3F, 0xC2,
+        0x87, 0x7A, 0xBC, 0x41, 0xF1, 0x0C, 0xCA, 0x37,
+        0x6B, 0x96, 0x50, 0xAD, 0x1D, 0xE0, 0x26, 0xDB
+    }
+#endif
+};
+#endif
+
+/**
+ * update FCS with data, the data of a frame can be calculated by several calls
+ *
+ * @param fcs       the FCS has been calculated, CMUX_FCS_INIT for the first call
+ * @param input     the point of data
+ * @param length    the length of data
+ *
+ * @return  the FCS updated
+ */
+rt_uint8_t cmux_fcs_update(rt_uint8_t fcs, const rt_uint8_t *input, rt_size_t length)
+{
+#if CMUX_FCS_SLICE == 8
+    while (length >= 8)
+    {
+        fcs = cmux_crctable_slice[6][fcs ^ input[0]] ^ cmux_crctable_slice[5][input[1]] ^
+              cmux_crctable_slice[4][input[2]] ^ cmux_crctable_slice[3][input[3]] ^
+              cmux_crctable_slice[2][input[4]] ^ cmux_crctable_slice[1][input[5]] ^
+              cmux_crctable_slice[0][input[6]] ^ cmux_crctable[input[7]];
+        input += 8;
+        length -= 8;
+    }
+#elif CMUX_FCS_SLICE == 4
+    while (length >= 4)
+    {
+        fcs = cmux_crctable_slice[2][fcs ^ input[0]] ^ cmux_crctable_slice[1][input[1]] ^
+              cmux_crctable_slice[0][input[2]] ^ cmux_crctable[input[3]];
+        input += 4;
+        length -= 4;
+    }
+#endif
+    while (length--)
+    {
+        fcs = cmux_crctable[fcs ^ *input++];
+    }
+    return fcs;
+}
+
 rt_uint8_t cmux_frame_check(const rt_uint8_t *input, int length)
 {
-    rt_uint8_t fcs = 0xFF;
-    int i;
-    for (i = 0; i < length; i++)
+    return (0xFF - cmux_fcs_update(CMUX_FCS_INIT, input, length));
+}
+
+#ifdef CMUX_USING_ADVANCED_OPTION
+/* a word filled with the byte */
+#define CMUX_ADV_WORD(byte) (((rt_ubase_t)~(rt_ubase_t)0 / 0xFF) * (byte))
+/* non zero when any byte of the word is zero */
+#define CMUX_ADV_HAS_ZERO(word) (((word) - CMUX_ADV_WORD(0x01)) & ~(word) & CMUX_ADV_WORD(0x80))
+
+/**
+ * find the first flag or escape octet of advanced option, the aligned words without them are skipped at once
+ *
+ * @param input     the point of data
+ * @param length    the length of data
+ *
+ * @return  the offset of the first flag or escape octet, length when there is none
+ */
+rt_size_t cmux_adv_scan(const rt_uint8_t *input, rt_size_t length)
+{
+    const rt_uint8_t *point = input, *end = input + length;
+    rt_ubase_t word;
+
+    while (point < end && ((rt_ubase_t)point & (sizeof(rt_ubase_t) - 1)) != 0)
+    {
+        if (*point == CMUX_ADV_FLAG || *point == CMUX_ADV_ESCAPE)
+        {
+            return point - input;
+        }
+        point++;
+    }
+    while ((rt_size_t)(end - point) >= sizeof(rt_ubase_t))
+    {
+        word = *(const rt_ubase_t *)point;
+        if (CMUX_ADV_HAS_ZERO(word ^ CMUX_ADV_WORD(CMUX_ADV_FLAG)) || CMUX_ADV_HAS_ZERO(word ^ CMUX_ADV_WORD(CMUX_ADV_ESCAPE)))
+        {
+            break;
+        }
+        point += sizeof(rt_ubase_t);
+    }
+    while (point < end && *point != CMUX_ADV_FLAG && *point != CMUX_ADV_ESCAPE)
+    {
+        point++;
+    }
+    return point - input;
+}
+
+/**
+ * escape data for advanced option, flag and escape octets are replaced by the escape octet and the byte XORed
+ *
+ * @param output    the escaped data, it must hold twice the length of input
+ * @param input     the point of data
+ * @param length    the length of data
+ *
+ * @return  the length of escaped data
+ */
+rt_size_t cmux_adv_escape(rt_uint8_t *output, const rt_uint8_t *input, rt_size_t length)
+{
+    rt_uint8_t *point = output;
+    rt_size_t size;
+
+    while (length > 0)
     {
-        fcs = cmux_crctable[fcs ^ input[i]];
+        size = cmux_adv_scan(input, length);
+        rt_memcpy(point, input, size);
+        point += size;
+        input += size;
+        length -= size;
+        if (length > 0)
+        {
+            *point++ = CMUX_ADV_ESCAPE;
+            *point++ = *input++ ^ CMUX_ADV_XOR;
+            length--;
+        }
     }
-    return (0xFF - fcs);
+    return point - output;
 }
+#endif
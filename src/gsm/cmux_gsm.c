@@ -41,6 +41,11 @@
 #define CMUX_CMD "AT+CMUX=0,0,5,2048,20,3,30,10,2"
 #endif
 
+/* the max ticks waiting for UA of the modem still in multiplexer mode, 0 means always running AT commands */
+#ifndef CMUX_PROBE_TIME
+#define CMUX_PROBE_TIME (CMUX_DLC_T1 * 2)
+#endif
+
 static struct cmux *gsm = RT_NULL;
 static char cmux_cmd[64] = { CMUX_CMD };
 
@@ -86,6 +91,42 @@ void cmux_at_cmd_cfg(uint8_t mode, uint8_t subset, uint32_t port_speed, uint32_t
             T3, k);
 }
 
+/**
+ * get a parameter from the AT+CMUX command
+ *
+ * @param cmd the AT+CMUX command
+ * @param index the position of parameter, 0 is mode and 3 is N1
+ * @param value the default value when the parameter is omitted
+ *
+ * @return the value of parameter
+ */
+static rt_uint32_t cmux_at_cmd_param(const char *cmd, int index, rt_uint32_t value)
+{
+    rt_uint32_t param = 0;
+    rt_bool_t found = RT_FALSE;
+    int now = 0;
+
+    cmd = rt_strstr(cmd, "=");
+    if (cmd == RT_NULL)
+    {
+        return value;
+    }
+    for (cmd++; *cmd != '\0' && now <= index; cmd++)
+    {
+        if (*cmd == ',')
+        {
+            now++;
+        }
+        else if (now == index && *cmd >= '0' && *cmd <= '9')
+        {
+            param = param * 10 + (*cmd - '0');
+            found = RT_TRUE;
+        }
+    }
+
+    return found ? param : value;
+}
+
 static rt_err_t cmux_at_command(struct rt_device *device)
 {
     /* private control, you can add power control */
@@ -98,6 +139,9 @@ static rt_err_t cmux_gsm_start(struct cmux *obj)
 {
     rt_err_t result = 0;
     struct rt_device *device = RT_NULL;
+    rt_uint32_t frame_size;
+    rt_uint8_t mode;
+    struct cmux_erm_cfg erm;
 
     device = obj->dev;
     /* using DMA mode first */
@@ -114,13 +158,54 @@ static rt_err_t cmux_gsm_start(struct cmux *obj)
     }
     LOG_I("cmux has been control %s.", device->parent.name);
 
-    result = cmux_at_command(device);
-    if(result != RT_EOK)
+    /* the framing of AT+CMUX is checked before the modem enters multiplexer mode */
+    mode = cmux_at_cmd_param(cmux_cmd, 0, CMUX_MODE_BASIC);
+    result = cmux_control(obj, CMUX_CTRL_SET_MODE, &mode);
+    if (result != RT_EOK)
+    {
+        LOG_E("cmux mode(%d) of %s isn't supported, define CMUX_USING_ADVANCED_OPTION for mode 1.", mode, cmux_cmd);
+        goto _end;
+    }
+
+    /* subset 2 is error recovery mode, T1 is in units of 10 ms */
+    erm.window = 0;
+    erm.retries = cmux_at_cmd_param(cmux_cmd, 5, 3);
+    erm.t1 = rt_tick_from_millisecond(cmux_at_cmd_param(cmux_cmd, 4, 10) * 10);
+    if (cmux_at_cmd_param(cmux_cmd, 1, 0) == 2)
+    {
+        erm.window = cmux_at_cmd_param(cmux_cmd, 8, 2);
+    }
+    result = cmux_control(obj, CMUX_CTRL_SET_ERROR_RECOVERY, &erm);
+    if (result != RT_EOK)
     {
-        LOG_E("cmux start failed.");
+        LOG_E("cmux subset of %s isn't supported, define CMUX_USING_ERROR_RECOVERY for subset 2.", cmux_cmd);
         goto _end;
     }
 
+    /* the modem keeps multiplexer mode after MCU reset, it doesn't answer AT commands then */
+    if (CMUX_PROBE_TIME > 0 && cmux_probe(obj, CMUX_PROBE_TIME) == RT_EOK)
+    {
+        LOG_I("cmux session of the modem is reused, AT commands are skipped.");
+    }
+    else
+    {
+        /* the SABMs of probe are an unfinished command line for the modem in AT mode */
+        if (CMUX_PROBE_TIME > 0)
+        {
+            rt_device_write(device, 0, "\r", 1);
+        }
+        result = cmux_at_command(device);
+        if(result != RT_EOK)
+        {
+            LOG_E("cmux start failed.");
+            goto _end;
+        }
+    }
+
+    /* N1 defaults to 31 in basic option and 64 in advanced option */
+    frame_size = cmux_at_cmd_param(cmux_cmd, 3, (mode == CMUX_MODE_BASIC) ? 31 : 64);
+    cmux_control(obj, CMUX_CTRL_SET_FRAME_SIZE, &frame_size);
+
 _end:
     return result;
 }
@@ -0,0 +1,902 @@
+/*
+ * Copyright (c) 2006-2026, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author         Notes
+ * 2026-10-17     agent          the first version, simulated modem over a device
+ */
+
+#include <cmux.h>
+#include <cmux_sim.h>
+#include <rtthread.h>
+#include <rtdevice.h>
+#include <rthw.h>
+
+#define DBG_TAG "cmux.sim"
+
+#ifdef CMUX_DEBUG
+#define DBG_LVL DBG_LOG
+#else
+#define DBG_LVL DBG_INFO
+#endif
+
+#include <rtdbg.h>
+
+/**
+ * a simulated 27.010 modem, it works as the actual serial of cmux object, set CMUX_DEPEND_NAME to CMUX_SIM_NAME.
+ * it answers OK to AT commands and enters multiplexer mode after AT+CMUX, then it answers UA to SABM and DISC,
+ * echoes UI and UIH frames of data channels, and answers commands on the control channel with the same content,
+ * except that N1 of PN is limited to CMUX_SIM_FRAME_SIZE.
+ * AT+CMUX=1 switches it to advanced option when CMUX_USING_ADVANCED_OPTION is defined, and subset 2 of it
+ * echoes I frames in error recovery mode when CMUX_USING_ERROR_RECOVERY is defined, frames can be lost on purpose.
+ * no hardware is needed, so cmux can be run and measured on the simulator BSP of RT-Thread.
+ */
+
+/* the data from modem waiting for reading */
+#ifndef CMUX_SIM_BUFFER_SIZE
+#define CMUX_SIM_BUFFER_SIZE 8192
+#endif
+
+/* the largest N1 accepted by PN */
+#ifndef CMUX_SIM_FRAME_SIZE
+#define CMUX_SIM_FRAME_SIZE CMUX_FRAME_SIZE_MAX
+#endif
+
+#define CMUX_SIM_LINE_MAX 64
+#define CMUX_SIM_FRAME_MAX (CMUX_FRAME_SIZE_MAX + CMUX_FRAME_OVERHEAD)
+#ifdef CMUX_USING_ADVANCED_OPTION
+/* every byte of a frame may be escaped into two */
+#define CMUX_SIM_REPLY_MAX (CMUX_SIM_FRAME_MAX * 2)
+#else
+#define CMUX_SIM_REPLY_MAX CMUX_SIM_FRAME_MAX
+#endif
+
+#define CMUX_SIM_FLAG 0xF9
+#define CMUX_SIM_EA 1
+#define CMUX_SIM_CR 2
+#define CMUX_SIM_PF 16
+#define CMUX_SIM_SABM 47
+#define CMUX_SIM_UA 99
+#define CMUX_SIM_DISC 67
+#define CMUX_SIM_UIH 239
+#define CMUX_SIM_UI 3
+#define CMUX_SIM_RR 1
+#define CMUX_SIM_RNR 5
+#define CMUX_SIM_REJ 9
+#define CMUX_SIM_C_PN 129
+/* FCS of UI frame and I frame covers the data */
+#define CMUX_SIM_FCS_DATA(control) (((control) & ~CMUX_SIM_PF) == CMUX_SIM_UI || ((control) & 1) == 0)
+
+#ifdef CMUX_USING_ERROR_RECOVERY
+/* the data channels in error recovery mode */
+#ifndef CMUX_SIM_CHANNEL_MAX
+#define CMUX_SIM_CHANNEL_MAX 8
+#endif
+#define CMUX_SIM_SEQ(n) ((n) & 7)
+
+struct cmux_sim_erm
+{
+    rt_uint8_t vs;                                        /* N(S) of the next I frame to cmux */
+    rt_uint8_t va;                                        /* the oldest I frame cmux hasn't acknowledged */
+    rt_uint8_t vr;                                        /* N(S) of the next I frame expected from cmux */
+    rt_bool_t rej_sent;                                   /* REJ sent, wait for the expected I frame */
+    rt_bool_t busy;                                       /* an I frame from cmux was dropped because window was full */
+    rt_bool_t peer_busy;                                  /* RNR received, cmux can't take I frames */
+    rt_bool_t stale;                                      /* no acknowledgement since the last tick of T1 */
+    rt_uint8_t *sent[8];                                  /* the I frames cmux hasn't acknowledged, indexed by N(S) */
+    rt_size_t sent_length[8];
+};
+#endif
+
+struct cmux_sim
+{
+    struct rt_device parent;
+
+    struct rt_ringbuffer rx_rb;                           /* the data from modem to cmux */
+    rt_uint8_t rx_pool[CMUX_SIM_BUFFER_SIZE];
+
+    rt_bool_t mux;                                        /* modem is in multiplexer mode */
+#ifdef CMUX_USING_ADVANCED_OPTION
+    rt_bool_t advanced;                                   /* the frames are in advanced option */
+    rt_bool_t escaped;                                    /* the last byte from cmux is the escape octet */
+#endif
+#ifdef CMUX_USING_ERROR_RECOVERY
+    rt_uint8_t window;                                    /* k of error recovery mode, 0 when it is off */
+    struct rt_timer t1;                                   /* T1 of modem, the frames not acknowledged in two ticks are sent again */
+    struct rt_mutex lock;                                 /* T1 and the writes of cmux both send frames */
+    struct cmux_sim_erm erm[CMUX_SIM_CHANNEL_MAX];
+    rt_uint32_t rx_loss;                                  /* every rx_loss-th I frame from cmux is lost */
+    rt_uint32_t tx_loss;                                  /* every tx_loss-th I frame to cmux is lost */
+    rt_uint32_t rx_count;
+    rt_uint32_t tx_count;
+#endif
+    char line[CMUX_SIM_LINE_MAX];                         /* AT command being received */
+    rt_size_t line_length;
+
+    rt_bool_t flag_found;                                 /* the start flag of frame has been received */
+    rt_uint8_t frame[CMUX_SIM_FRAME_MAX];                 /* frame from cmux being received, without start flag */
+    rt_size_t frame_length;
+    rt_uint8_t reply[CMUX_SIM_REPLY_MAX];                 /* frame from modem being assembled, writes of cmux are serialized */
+
+    rt_uint32_t dropped;                                  /* frames dropped because rx_rb is full */
+};
+
+static struct cmux_sim cmux_sim;
+
+/**
+ *  put data into rx_rb, the data is dropped when there is no enough space
+ *
+ * @param sim           simulated modem
+ * @param data          the point of data
+ * @param length        the length of data
+ *
+ * @return  RT_EOK      successful
+ *          -RT_EFULL   no enough space
+ */
+static rt_err_t cmux_sim_put(struct cmux_sim *sim, const rt_uint8_t *data, rt_size_t length)
+{
+    rt_base_t level;
+
+    level = rt_hw_interrupt_disable();
+    if (rt_ringbuffer_space_len(&sim->rx_rb) < length)
+    {
+        sim->dropped++;
+        rt_hw_interrupt_enable(level);
+        return -RT_EFULL;
+    }
+    rt_ringbuffer_put(&sim->rx_rb, data, length);
+    rt_hw_interrupt_enable(level);
+
+    if (sim->parent.rx_indicate != RT_NULL)
+    {
+        sim->parent.rx_indicate(&sim->parent, length);
+    }
+
+    return RT_EOK;
+}
+
+#ifdef CMUX_USING_ADVANCED_OPTION
+/**
+ *  assemble a frame of advanced option from modem and put it into rx_rb
+ *
+ * @param sim           simulated modem
+ * @param channel       the DLCI of frame
+ * @param control       the control field of frame
+ * @param cr            C/R bit of address field
+ * @param data          the data of frame
+ * @param length        the length of data
+ *
+ * @return  RT_EOK      successful
+ *          -RT_EFULL   no enough space
+ */
+static rt_err_t cmux_sim_send_advanced(struct cmux_sim *sim, rt_uint8_t channel, rt_uint8_t control, rt_uint8_t cr,
+                                       const rt_uint8_t *data, rt_size_t length)
+{
+    rt_uint8_t *frame = sim->reply;
+    rt_uint8_t header[2], fcs;
+    rt_size_t size = 0;
+
+    header[0] = (channel << 2) | cr | CMUX_SIM_EA;
+    header[1] = control;
+    fcs = cmux_fcs_update(CMUX_FCS_INIT, header, 2);
+    if (CMUX_SIM_FCS_DATA(control))
+    {
+        fcs = cmux_fcs_update(fcs, data, length);
+    }
+    fcs = 0xFF - fcs;
+
+    frame[size++] = CMUX_ADV_FLAG;
+    size += cmux_adv_escape(frame + size, header, 2);
+    size += cmux_adv_escape(frame + size, data, length);
+    size += cmux_adv_escape(frame + size, &fcs, 1);
+    frame[size++] = CMUX_ADV_FLAG;
+
+    return cmux_sim_put(sim, frame, size);
+}
+#endif
+
+/**
+ *  assemble a frame from modem and put it into rx_rb
+ *
+ * @param sim           simulated modem
+ * @param channel       the DLCI of frame
+ * @param control       the control field of frame
+ * @param cr            C/R bit of address field
+ * @param data          the data of frame
+ * @param length        the length of data
+ *
+ * @return  RT_EOK      successful
+ *          -RT_EFULL   no enough space
+ */
+static rt_err_t cmux_sim_send(struct cmux_sim *sim, rt_uint8_t channel, rt_uint8_t control, rt_uint8_t cr,
+                              const rt_uint8_t *data, rt_size_t length)
+{
+    rt_uint8_t *frame = sim->reply;
+    rt_size_t header = 4;
+
+#ifdef CMUX_USING_ADVANCED_OPTION
+    if (sim->advanced)
+    {
+        return cmux_sim_send_advanced(sim, channel, control, cr, data, length);
+    }
+#endif
+    frame[0] = CMUX_SIM_FLAG;
+    frame[1] = (channel << 2) | cr | CMUX_SIM_EA;
+    frame[2] = control;
+    if (length > 127)
+    {
+        frame[3] = (length & 127) << 1;
+        frame[4] = length >> 7;
+        header = 5;
+    }
+    else
+    {
+        frame[3] = (length << 1) | CMUX_SIM_EA;
+    }
+    rt_memcpy(frame + header, data, length);
+    if (CMUX_SIM_FCS_DATA(control))
+    {
+        frame[header + length] = cmux_frame_check(frame + 1, header + length - 1);
+    }
+    else
+    {
+        frame[header + length] = cmux_frame_check(frame + 1, header - 1);
+    }
+    frame[header + length + 1] = CMUX_SIM_FLAG;
+
+    return cmux_sim_put(sim, frame, header + length + 2);
+}
+
+#ifdef CMUX_USING_ERROR_RECOVERY
+/**
+ *  send an I frame to cmux and keep it until cmux acknowledges it, the frame may be lost on purpose
+ *
+ * @param sim           simulated modem
+ * @param channel       the DLCI of frame
+ * @param data          the data of frame
+ * @param length        the length of data
+ */
+static void cmux_sim_erm_send(struct cmux_sim *sim, rt_uint8_t channel, const rt_uint8_t *data, rt_size_t length)
+{
+    struct cmux_sim_erm *erm = &sim->erm[channel];
+    rt_uint8_t ns = erm->vs;
+
+    erm->sent[ns] = rt_malloc(length > 0 ? length : 1);
+    if (erm->sent[ns] == RT_NULL)
+    {
+        return;
+    }
+    rt_memcpy(erm->sent[ns], data, length);
+    erm->sent_length[ns] = length;
+    erm->vs = CMUX_SIM_SEQ(ns + 1);
+
+    if (sim->tx_loss > 0 && ++sim->tx_count % sim->tx_loss == 0)
+    {
+        LOG_D("I frame %d to channel(%d) is lost.", ns, channel);
+        return;
+    }
+    cmux_sim_send(sim, channel, (ns << 1) | (erm->vr << 5), 0, data, length);
+}
+
+/**
+ *  release the I frames acknowledged by N(R) from cmux
+ *
+ * @param sim           simulated modem
+ * @param channel       the DLCI of frame
+ * @param nr            N(R) of the frame from cmux
+ */
+static void cmux_sim_erm_ack(struct cmux_sim *sim, rt_uint8_t channel, rt_uint8_t nr)
+{
+    struct cmux_sim_erm *erm = &sim->erm[channel];
+
+    if (CMUX_SIM_SEQ(nr - erm->va) > CMUX_SIM_SEQ(erm->vs - erm->va))
+    {
+        return;
+    }
+    while (erm->va != nr)
+    {
+        rt_free(erm->sent[erm->va]);
+        erm->sent[erm->va] = RT_NULL;
+        erm->va = CMUX_SIM_SEQ(erm->va + 1);
+        erm->stale = RT_FALSE;
+    }
+    /* ask cmux to send the dropped I frames again, there is room now */
+    if (erm->busy && !erm->peer_busy && CMUX_SIM_SEQ(erm->vs - erm->va) < sim->window)
+    {
+        erm->busy = RT_FALSE;
+        cmux_sim_send(sim, channel, CMUX_SIM_REJ | (erm->vr << 5), CMUX_SIM_CR, RT_NULL, 0);
+    }
+}
+
+/**
+ *  send the I frames cmux hasn't acknowledged again, with the current N(R)
+ *
+ * @param sim           simulated modem
+ * @param channel       the DLCI of frame
+ * @param poll          set P bit in the last frame
+ */
+static void cmux_sim_erm_retransmit(struct cmux_sim *sim, rt_uint8_t channel, rt_bool_t poll)
+{
+    struct cmux_sim_erm *erm = &sim->erm[channel];
+    rt_uint8_t ns, control;
+
+    for (ns = erm->va; ns != erm->vs; ns = CMUX_SIM_SEQ(ns + 1))
+    {
+        control = (ns << 1) | (erm->vr << 5);
+        if (poll && CMUX_SIM_SEQ(ns + 1) == erm->vs)
+        {
+            control |= CMUX_SIM_PF;
+        }
+        cmux_sim_send(sim, channel, control, 0, erm->sent[ns], erm->sent_length[ns]);
+    }
+}
+
+/**
+ *  T1 of modem, the I frames not acknowledged for a whole tick are sent again with a poll
+ *
+ * @param parameter     simulated modem
+ */
+static void cmux_sim_t1_timeout(void *parameter)
+{
+    struct cmux_sim *sim = (struct cmux_sim *)parameter;
+    struct cmux_sim_erm *erm = RT_NULL;
+    int i;
+
+    rt_mutex_take(&sim->lock, RT_WAITING_FOREVER);
+    for (i = 1; i < CMUX_SIM_CHANNEL_MAX; i++)
+    {
+        erm = &sim->erm[i];
+        if (erm->va != erm->vs && erm->stale && !erm->peer_busy)
+        {
+            cmux_sim_erm_retransmit(sim, i, RT_TRUE);
+        }
+        erm->stale = (erm->va != erm->vs);
+    }
+    rt_mutex_release(&sim->lock);
+}
+
+/**
+ *  handle an I frame or supervisory frame from cmux in error recovery mode, I frames in sequence are echoed
+ *
+ * @param sim           simulated modem
+ * @param channel       the DLCI of frame
+ * @param control       the control field of frame
+ * @param data          the data of frame
+ * @param length        the length of data
+ */
+static void cmux_sim_erm_handle(struct cmux_sim *sim, rt_uint8_t channel, rt_uint8_t control, const rt_uint8_t *data,
+                                rt_size_t length)
+{
+    struct cmux_sim_erm *erm = &sim->erm[channel];
+
+    if ((control & 1) == 0 && sim->rx_loss > 0 && ++sim->rx_count % sim->rx_loss == 0)
+    {
+        LOG_D("I frame %d from channel(%d) is lost.", (control >> 1) & 7, channel);
+        return;
+    }
+
+    if ((control & 1) == 1)
+    {
+        switch (control & 0x0F)
+        {
+        case CMUX_SIM_RNR:
+            erm->peer_busy = RT_TRUE;
+            break;
+        case CMUX_SIM_REJ:
+            erm->peer_busy = RT_FALSE;
+            cmux_sim_erm_ack(sim, channel, control >> 5);
+            cmux_sim_erm_retransmit(sim, channel, RT_FALSE);
+            break;
+        default:
+            /* the I frames dropped by busy cmux are sent again */
+            if (erm->peer_busy)
+            {
+                erm->peer_busy = RT_FALSE;
+                cmux_sim_erm_ack(sim, channel, control >> 5);
+                cmux_sim_erm_retransmit(sim, channel, RT_FALSE);
+            }
+            break;
+        }
+        cmux_sim_erm_ack(sim, channel, control >> 5);
+    }
+    else if (((control >> 1) & 7) != erm->vr)
+    {
+        cmux_sim_erm_ack(sim, channel, control >> 5);
+        /* cmux polls after T1 when its frames or our frames are lost, only one REJ is sent for the others */
+        if (!erm->rej_sent || (control & CMUX_SIM_PF))
+        {
+            erm->rej_sent = RT_TRUE;
+            cmux_sim_send(sim, channel, CMUX_SIM_REJ | (erm->vr << 5) | (control & CMUX_SIM_PF), CMUX_SIM_CR, RT_NULL, 0);
+            cmux_sim_erm_retransmit(sim, channel, RT_FALSE);
+        }
+    }
+    else
+    {
+        cmux_sim_erm_ack(sim, channel, control >> 5);
+        /* cmux polls after T1, the modem sends its frames not acknowledged again as if its T1 expired */
+        if (control & CMUX_SIM_PF)
+        {
+            cmux_sim_erm_retransmit(sim, channel, RT_FALSE);
+        }
+        if (erm->peer_busy || CMUX_SIM_SEQ(erm->vs - erm->va) >= sim->window)
+        {
+            erm->busy = RT_TRUE;
+        }
+        else
+        {
+            erm->vr = CMUX_SIM_SEQ(erm->vr + 1);
+            erm->rej_sent = RT_FALSE;
+            cmux_sim_erm_send(sim, channel, data, length);
+        }
+        /* the echo carries N(R), a poll is answered by RR */
+        if (control & CMUX_SIM_PF)
+        {
+            cmux_sim_send(sim, channel, CMUX_SIM_RR | (erm->vr << 5) | CMUX_SIM_PF, CMUX_SIM_CR, RT_NULL, 0);
+        }
+    }
+}
+
+/**
+ *  clear the state of a channel in error recovery mode, SABM sets up the channel again
+ *
+ * @param sim           simulated modem
+ * @param channel       the DLCI
+ */
+static void cmux_sim_erm_clear(struct cmux_sim *sim, rt_uint8_t channel)
+{
+    struct cmux_sim_erm *erm = &sim->erm[channel];
+
+    while (erm->va != erm->vs)
+    {
+        rt_free(erm->sent[erm->va]);
+        erm->sent[erm->va] = RT_NULL;
+        erm->va = CMUX_SIM_SEQ(erm->va + 1);
+    }
+    rt_memset(erm, 0, sizeof(struct cmux_sim_erm));
+}
+
+/**
+ *  reset error recovery mode, it is set up by subset 2, T1 and window size k of AT+CMUX
+ *
+ * @param sim           simulated modem
+ * @param window        window size k, 0 turns it off
+ * @param t1            T1 in ticks
+ */
+static void cmux_sim_erm_reset(struct cmux_sim *sim, rt_uint8_t window, rt_tick_t t1)
+{
+    int i;
+
+    rt_timer_stop(&sim->t1);
+    for (i = 0; i < CMUX_SIM_CHANNEL_MAX; i++)
+    {
+        cmux_sim_erm_clear(sim, i);
+    }
+    sim->window = window;
+    if (window > 0)
+    {
+        rt_timer_control(&sim->t1, RT_TIMER_CTRL_SET_TIME, &t1);
+        rt_timer_start(&sim->t1);
+    }
+    sim->rx_count = 0;
+    sim->tx_count = 0;
+}
+
+/**
+ * lose I frames of error recovery mode on purpose, the counters restart
+ *
+ * @param rx_every      every rx_every-th I frame from cmux is lost, 0 loses none
+ * @param tx_every      every tx_every-th I frame to cmux is lost, 0 loses none
+ */
+void cmux_sim_set_loss(rt_uint32_t rx_every, rt_uint32_t tx_every)
+{
+    cmux_sim.rx_loss = rx_every;
+    cmux_sim.tx_loss = tx_every;
+    cmux_sim.rx_count = 0;
+    cmux_sim.tx_count = 0;
+}
+#endif
+
+#ifdef CMUX_USING_ADVANCED_OPTION
+/**
+ * get a parameter of AT+CMUX
+ *
+ * @param line          the AT command
+ * @param index         the position of parameter, 0 is mode and 1 is subset
+ * @param value         the value when the parameter is omitted
+ *
+ * @return  the value of parameter
+ */
+static rt_uint32_t cmux_sim_at_param(const char *line, int index, rt_uint32_t value)
+{
+    rt_uint32_t param = 0;
+    rt_bool_t found = RT_FALSE;
+    int now = 0;
+
+    if (line[7] != '=')
+    {
+        return value;
+    }
+    for (line += 8; *line != '\0' && now <= index; line++)
+    {
+        if (*line == ',')
+        {
+            now++;
+        }
+        else if (now == index && *line >= '0' && *line <= '9')
+        {
+            param = param * 10 + (*line - '0');
+            found = RT_TRUE;
+        }
+    }
+
+    return found ? param : value;
+}
+#endif
+
+/**
+ *  handle a whole frame from cmux
+ *
+ * @param sim           simulated modem
+ * @param frame         the frame without flags
+ * @param header        the length of address, control and length field
+ * @param length        the length of frame data
+ */
+static void cmux_sim_frame_handle(struct cmux_sim *sim, rt_uint8_t *frame, rt_size_t header, rt_size_t length)
+{
+    rt_uint8_t channel = frame[0] >> 2;
+    rt_uint8_t control = frame[1] & ~CMUX_SIM_PF;
+    rt_uint8_t fcs;
+
+    if (CMUX_SIM_FCS_DATA(control))
+    {
+        fcs = cmux_frame_check(frame, header + length);
+    }
+    else
+    {
+        fcs = cmux_frame_check(frame, header);
+    }
+    if (fcs != frame[header + length])
+    {
+        LOG_W("frame of channel(%d) is dropped, FCS doesn't match.", channel);
+        return;
+    }
+#ifdef CMUX_USING_ERROR_RECOVERY
+    /* I frames and supervisory frames of data channels */
+    if (sim->window > 0 && channel > 0 && channel < CMUX_SIM_CHANNEL_MAX && (control & 3) != 3)
+    {
+        cmux_sim_erm_handle(sim, channel, frame[1], frame + header, length);
+        return;
+    }
+#endif
+
+    switch (control)
+    {
+    case CMUX_SIM_SABM:
+    case CMUX_SIM_DISC:
+#ifdef CMUX_USING_ERROR_RECOVERY
+        if (channel < CMUX_SIM_CHANNEL_MAX)
+        {
+            cmux_sim_erm_clear(sim, channel);
+        }
+#endif
+        cmux_sim_send(sim, channel, CMUX_SIM_UA | CMUX_SIM_PF, CMUX_SIM_CR, RT_NULL, 0);
+        break;
+    case CMUX_SIM_UI:
+    case CMUX_SIM_UIH:
+        if (channel == 0)
+        {
+            /* control channel command, the response is the same command with C/R bit cleared */
+            if (length > 0 && (frame[header] & CMUX_SIM_CR))
+            {
+                /* type, length and 8 values of PN, N1 is the 5th and 6th value */
+                if (frame[header] == (CMUX_SIM_C_PN | CMUX_SIM_CR) && length >= 10 &&
+                    (frame[header + 6] | (frame[header + 7] << 8)) > CMUX_SIM_FRAME_SIZE)
+                {
+                    frame[header + 6] = CMUX_SIM_FRAME_SIZE & 0xFF;
+                    frame[header + 7] = CMUX_SIM_FRAME_SIZE >> 8;
+                }
+                frame[header] &= ~CMUX_SIM_CR;
+                cmux_sim_send(sim, 0, CMUX_SIM_UIH, 0, frame + header, length);
+            }
+        }
+        else
+        {
+            cmux_sim_send(sim, channel, control, 0, frame + header, length);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ *  handle the data from cmux in multiplexer mode, frames are found by their length field
+ *
+ * @param sim           simulated modem
+ * @param data          the data from cmux
+ * @param length        the length of data
+ */
+static void cmux_sim_mux_input(struct cmux_sim *sim, const rt_uint8_t *data, rt_size_t length)
+{
+    rt_size_t i, header, data_length;
+
+    for (i = 0; i < length; i++)
+    {
+        if (!sim->flag_found)
+        {
+            sim->flag_found = (data[i] == CMUX_SIM_FLAG);
+            continue;
+        }
+        /* skip the flags between frames */
+        if (sim->frame_length == 0 && data[i] == CMUX_SIM_FLAG)
+        {
+            continue;
+        }
+        sim->frame[sim->frame_length++] = data[i];
+        if (sim->frame_length < 3 || (sim->frame_length == 3 && !(sim->frame[2] & CMUX_SIM_EA)))
+        {
+            continue;
+        }
+
+        header = (sim->frame[2] & CMUX_SIM_EA) ? 3 : 4;
+        data_length = sim->frame[2] >> 1;
+        if (header == 4)
+        {
+            data_length |= sim->frame[3] << 7;
+        }
+        if (header + data_length + 2 > CMUX_SIM_FRAME_MAX)
+        {
+            LOG_W("frame is dropped, data length(%d) is too long.", (int)data_length);
+            sim->frame_length = 0;
+            sim->flag_found = RT_FALSE;
+            continue;
+        }
+        /* header, data, FCS and end flag */
+        if (sim->frame_length == header + data_length + 2)
+        {
+            if (sim->frame[sim->frame_length - 1] == CMUX_SIM_FLAG)
+            {
+                cmux_sim_frame_handle(sim, sim->frame, header, data_length);
+            }
+            else
+            {
+                LOG_W("frame is dropped, end flag not found.");
+                sim->flag_found = RT_FALSE;
+            }
+            sim->frame_length = 0;
+        }
+    }
+}
+
+#ifdef CMUX_USING_ADVANCED_OPTION
+/**
+ *  handle the data from cmux in advanced option, frames are delimited by flags and unescaped byte by byte
+ *
+ * @param sim           simulated modem
+ * @param data          the data from cmux
+ * @param length        the length of data
+ */
+static void cmux_sim_adv_input(struct cmux_sim *sim, const rt_uint8_t *data, rt_size_t length)
+{
+    rt_size_t i;
+    rt_uint8_t byte;
+
+    for (i = 0; i < length; i++)
+    {
+        byte = data[i];
+        if (byte == CMUX_ADV_FLAG)
+        {
+            /* address, control and FCS at least */
+            if (sim->flag_found && sim->frame_length >= 3 && !sim->escaped)
+            {
+                cmux_sim_frame_handle(sim, sim->frame, 2, sim->frame_length - 3);
+            }
+            else if (sim->frame_length > 0)
+            {
+                LOG_W("frame is dropped, it is aborted or too short.");
+            }
+            sim->flag_found = RT_TRUE;
+            sim->frame_length = 0;
+            sim->escaped = RT_FALSE;
+            continue;
+        }
+        if (!sim->flag_found)
+        {
+            continue;
+        }
+        if (byte == CMUX_ADV_ESCAPE)
+        {
+            sim->escaped = RT_TRUE;
+            continue;
+        }
+        if (sim->escaped)
+        {
+            byte ^= CMUX_ADV_XOR;
+            sim->escaped = RT_FALSE;
+        }
+        if (sim->frame_length == CMUX_SIM_FRAME_MAX)
+        {
+            LOG_W("frame is dropped, it is too long.");
+            sim->frame_length = 0;
+            sim->flag_found = RT_FALSE;
+            continue;
+        }
+        sim->frame[sim->frame_length++] = byte;
+    }
+}
+#endif
+
+/**
+ *  handle the AT commands from cmux, multiplexer mode starts after AT+CMUX
+ *
+ * @param sim           simulated modem
+ * @param data          the data from cmux
+ * @param length        the length of data
+ *
+ * @return  the length of data has been handled
+ */
+static rt_size_t cmux_sim_at_input(struct cmux_sim *sim, const rt_uint8_t *data, rt_size_t length)
+{
+    const char *ok = "\r\nOK\r\n";
+    rt_size_t i;
+
+    for (i = 0; i < length && !sim->mux; i++)
+    {
+        if (data[i] == '\r' || data[i] == '\n')
+        {
+            sim->line[sim->line_length] = '\0';
+            if (rt_strncmp(sim->line, "AT", 2) == 0)
+            {
+                cmux_sim_put(sim, (const rt_uint8_t *)ok, rt_strlen(ok));
+                if (rt_strncmp(sim->line, "AT+CMUX", 7) == 0)
+                {
+                    LOG_D("%s enters multiplexer mode.", CMUX_SIM_NAME);
+                    sim->mux = RT_TRUE;
+#ifdef CMUX_USING_ADVANCED_OPTION
+                    sim->advanced = (cmux_sim_at_param(sim->line, 0, 0) == 1);
+#endif
+#ifdef CMUX_USING_ERROR_RECOVERY
+                    cmux_sim_erm_reset(sim, (sim->advanced && cmux_sim_at_param(sim->line, 1, 0) == 2) ?
+                                       cmux_sim_at_param(sim->line, 8, 2) : 0,
+                                       rt_tick_from_millisecond(cmux_sim_at_param(sim->line, 4, 10) * 10));
+#endif
+                }
+            }
+            sim->line_length = 0;
+        }
+        else if (sim->line_length < CMUX_SIM_LINE_MAX - 1)
+        {
+            sim->line[sim->line_length++] = data[i];
+        }
+    }
+
+    return i;
+}
+
+/**
+ * put raw data into simulated modem as if modem sent it, it is used to test cmux with broken frames
+ *
+ * @param buffer        the data
+ * @param size          the length of data
+ *
+ * @return  RT_EOK      successful
+ *          -RT_EFULL   no enough space, nothing is put
+ */
+rt_err_t cmux_sim_inject(const void *buffer, rt_size_t size)
+{
+    return cmux_sim_put(&cmux_sim, buffer, size);
+}
+
+static rt_err_t cmux_sim_init(rt_device_t dev)
+{
+    struct cmux_sim *sim = (struct cmux_sim *)dev;
+
+    rt_ringbuffer_init(&sim->rx_rb, sim->rx_pool, CMUX_SIM_BUFFER_SIZE);
+    sim->mux = RT_FALSE;
+    sim->line_length = 0;
+    sim->flag_found = RT_FALSE;
+    sim->frame_length = 0;
+    sim->dropped = 0;
+#ifdef CMUX_USING_ADVANCED_OPTION
+    sim->advanced = RT_FALSE;
+    sim->escaped = RT_FALSE;
+#endif
+#ifdef CMUX_USING_ERROR_RECOVERY
+    cmux_sim_erm_reset(sim, 0, 0);
+#endif
+
+    return RT_EOK;
+}
+
+static rt_size_t cmux_sim_read(rt_device_t dev, rt_off_t pos, void *buffer, rt_size_t size)
+{
+    struct cmux_sim *sim = (struct cmux_sim *)dev;
+    rt_base_t level;
+
+    level = rt_hw_interrupt_disable();
+    size = rt_ringbuffer_get(&sim->rx_rb, buffer, size);
+    rt_hw_interrupt_enable(level);
+
+    return size;
+}
+
+static rt_size_t cmux_sim_write(rt_device_t dev, rt_off_t pos, const void *buffer, rt_size_t size)
+{
+    struct cmux_sim *sim = (struct cmux_sim *)dev;
+    rt_size_t length = 0;
+
+#ifdef CMUX_USING_ERROR_RECOVERY
+    rt_mutex_take(&sim->lock, RT_WAITING_FOREVER);
+#endif
+    if (!sim->mux)
+    {
+        length = cmux_sim_at_input(sim, buffer, size);
+    }
+    if (length < size)
+    {
+#ifdef CMUX_USING_ADVANCED_OPTION
+        if (sim->advanced)
+        {
+            cmux_sim_adv_input(sim, (const rt_uint8_t *)buffer + length, size - length);
+        }
+        else
+#endif
+        {
+            cmux_sim_mux_input(sim, (const rt_uint8_t *)buffer + length, size - length);
+        }
+    }
+#ifdef CMUX_USING_ERROR_RECOVERY
+    rt_mutex_release(&sim->lock);
+#endif
+
+    return size;
+}
+
+#ifdef RT_USING_DEVICE_OPS
+static const struct rt_device_ops cmux_sim_ops =
+{
+    cmux_sim_init,
+    RT_NULL,
+    RT_NULL,
+    cmux_sim_read,
+    cmux_sim_write,
+    RT_NULL,
+};
+#endif
+
+/**
+ * register the simulated modem
+ *
+ * @return  RT_EOK      successful
+ */
+int cmux_sim_device_init(void)
+{
+    struct rt_device *device = &cmux_sim.parent;
+
+    device->type = RT_Device_Class_Char;
+    device->rx_indicate = RT_NULL;
+    device->tx_complete = RT_NULL;
+
+#ifdef RT_USING_DEVICE_OPS
+    device->ops = &cmux_sim_ops;
+#else
+    device->init = cmux_sim_init;
+    device->open = RT_NULL;
+    device->close = RT_NULL;
+    device->read = cmux_sim_read;
+    device->write = cmux_sim_write;
+    device->control = RT_NULL;
+#endif
+
+#ifdef CMUX_USING_ERROR_RECOVERY
+    rt_mutex_init(&cmux_sim.lock, "cmux_sim", RT_IPC_FLAG_PRIO);
+    rt_timer_init(&cmux_sim.t1, "cmux_sim", cmux_sim_t1_timeout, &cmux_sim, RT_TICK_PER_SECOND / 10,
+                  RT_TIMER_FLAG_PERIODIC | RT_TIMER_FLAG_SOFT_TIMER);
+#endif
+    cmux_sim_init(device);
+
+    return rt_device_register(device, CMUX_SIM_NAME, RT_DEVICE_FLAG_RDWR | RT_DEVICE_FLAG_INT_RX);
+}
+INIT_DEVICE_EXPORT(cmux_sim_device_init);